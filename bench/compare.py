@@ -0,0 +1,31 @@
+import sys
+
+# lines up two result files of bench_suite by benchmark and parameters and
+# prints the throughput of the second relative to the first. a changed digest
+# means the two builds did not simulate the same thing.
+
+def load(path):
+	rows = {}
+	with open(path) as f:
+		for line in f:
+			fields = line.rstrip("\n").split("\t")
+			if len(fields) < 6 or fields[0] == "benchmark":
+				continue
+			rows[(fields[0], fields[1])] = (float(fields[4]), fields[5])
+	return rows
+
+if len(sys.argv) != 3:
+	print("Usage: python3 bench/compare.py [old results] [new results]")
+	sys.exit(0)
+
+old = load(sys.argv[1])
+new = load(sys.argv[2])
+print("benchmark\tparams\told ops/sec\tnew ops/sec\tratio\tdigest")
+for key in sorted(set(old) | set(new)):
+	if key not in old or key not in new:
+		print("%s\t%s\t%s" % (key[0], key[1], "only in old" if key in old else "only in new"))
+		continue
+	before, after = old[key][0], new[key][0]
+	ratio = after / before if before > 0 else 0
+	print("%s\t%s\t%.0f\t%.0f\t%.3f\t%s" % (key[0], key[1], before, after, ratio,
+		"same" if old[key][1] == new[key][1] else "CHANGED"))
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include "../rng.h"
+#include "../store.h"
+#include "../blockchain.h"
+
+using namespace std;
+
+// feeds the blocks of a random block tree into one BlockChain in forward,
+// reverse and shuffled order. in reverse order every block but the last is an
+// orphan and the last one connects all of them, the worst case of the orphan
+// pool. reports time per block and checks that every order ends at the same
+// height.
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		cout << "Usage: " << argv[0] << " [no. of blocks] [fork probability] [seed]" << endl;
+		exit(0);
+	}
+	size_t n = stoul(argv[1]);
+	double forkProbability = stod(argv[2]);
+	Stream stream(argc > 3 ? stoull(argv[3]) : 1);
+
+	// block i extends block i - 1, or with forkProbability one of the 8 before it
+	ObjectStore store(1);
+	vector<const Transaction*> noTxns;
+	vector<BlockNode*> blocks;
+	for (size_t i = 0; i < n; i++) {
+		BlockNode *parent = i > 0 ? blocks[i - 1] : store.genesis();
+		if (i > 0 && stream.uniform() < forkProbability) {
+			parent = blocks[i - 1 - stream.below(min(i, (size_t) 8))];
+		}
+		blocks.push_back(store.create_block(0, GENESIS_ID + 1 + i, parent->id(), noTxns, parent));
+	}
+
+	const char *orders[] = {"forward", "reverse", "shuffled"};
+	printf("order\tblocks\tseconds\tblocks/sec\tmax_orphans\theight\n");
+	unsigned long expected = 0;
+	for (int o = 0; o < 3; o++) {
+		vector<BlockNode*> feed(blocks);
+		if (o == 1) {
+			reverse(feed.begin(), feed.end());
+		} else if (o == 2) {
+			shuffle(feed.begin(), feed.end(), stream);
+		}
+		BlockChain chain(store.genesis());
+		size_t maxOrphans = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (size_t i = 0; i < feed.size(); i++) {
+			chain.add_block(feed[i], i);
+			maxOrphans = max(maxOrphans, chain.orphans());
+		}
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (o == 0) {
+			expected = chain.height();
+		}
+		printf("%s\t%zu\t%.4f\t%.0f\t%zu\t%lu%s\n", orders[o], n, seconds, seconds > 0 ? n / seconds : 0,
+		       maxOrphans, chain.height(), chain.height() == expected && chain.orphans() == 0 ? "" : " MISMATCH");
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <cstdio>
+#include "../network.h"
+
+using namespace std;
+
+// runs the same seeded network with 1 to maxThreads worker threads and reports
+// throughput, speedup over one thread and whether the final state matches
+int main(int argc, char **argv) {
+	if (argc < 4) {
+		cout << "Usage: " << argv[0] << " [no. of nodes] [simulated seconds] [max threads] [--key=value ...]" << endl;
+		exit(0);
+	}
+	int n = stoi(argv[1]);
+	double until = stod(argv[2]);
+	int maxThreads = stoi(argv[3]);
+	Options options;
+	options.topology = "er";
+	options.seed = 1;
+	if (!parse_options(argc, argv, 4, options)) {
+		exit(0);
+	}
+	options.logLevel = TRACE_SILENT;
+	options.latency = "exact";
+	options.until = until;
+
+	printf("threads\tevents\tseconds\tevents/sec\tspeedup\tcross\tdigest\n");
+	double base = 0;
+	unsigned long long expected = 0;
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		options.threads = threads;
+		Network network(n, 0.3, options);
+		network.simulate(numeric_limits<int>::max());
+		const RunStats &stats = network.stats();
+		double rate = stats.elapsed > 0 ? stats.events / stats.elapsed : 0;
+		unsigned long long digest = network.digest();
+		if (threads == 1) {
+			base = rate;
+			expected = digest;
+		}
+		printf("%d\t%llu\t%.3f\t%.0f\t%.2f\t%llu\t%s\n", threads, stats.events, stats.elapsed, rate,
+		       base > 0 ? rate / base : 0, stats.messages, digest == expected ? "match" : "MISMATCH");
+	}
+	return 0;
+}
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include "../network.h"
+
+using namespace std;
+
+// benchmarks of the simulator core at fixed seeds. every line of the output
+// is one measurement: benchmark, parameters, operations, seconds, operations
+// per second and a digest of the result, which must stay the same between
+// commits unless the simulation itself changed. bench/compare.py lines up two
+// result files. the last column is a size: simulation rows give the number
+// of queue entries left at the end, a sample of the queue size at steady
+// state, and seen_filter rows the bytes of one node's filter.
+
+double seconds_since(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void report(const char *benchmark, const string &params, unsigned long long ops, double seconds, unsigned long long digest,
+            size_t size = 0) {
+	printf("%s\t%s\t%llu\t%.4f\t%.0f\t%016llx\t%zu\n", benchmark, params.c_str(), ops, seconds,
+	       seconds > 0 ? ops / seconds : 0, digest, size);
+	fflush(stdout);
+}
+
+Options bench_options(double until) {
+	Options options;
+	options.seed = 1;
+	options.topology = "er";
+	options.latency = "exact";
+	options.logLevel = TRACE_SILENT;
+	options.until = until;
+	options.exportFile.clear();
+	return options;
+}
+
+// events per second of the sequential engine as the network and its degree
+// grow, with eager and lazy delivery. each run stops after the same number
+// of events
+void event_loop(double scale) {
+	int sizes[] = {100, 1000};
+	double degrees[] = {4, 8, 16};
+	const char *deliveries[] = {"eager", "lazy"};
+	for (int n : sizes) {
+		for (double degree : degrees) {
+			for (const char *delivery : deliveries) {
+				Options options = bench_options(numeric_limits<double>::infinity());
+				options.degree = degree;
+				options.delivery = delivery;
+				Network network(n, 0.3, options);
+				network.simulate((int) (scale * 1000000));
+				const RunStats &stats = network.stats();
+				report("event_loop", "n=" + to_string(n) + ",degree=" + to_string((int) degree) + "," + delivery,
+				       stats.events, stats.elapsed, network.digest(), network.queued());
+			}
+		}
+	}
+}
+
+// latency draws, one after another over every edge of a network
+void latency(double scale) {
+	Options options = bench_options(0);
+	Network network(1000, 0.3, options);
+	size_t edges = network.links().edges();
+	unsigned long long draws = (unsigned long long) (scale * 20000000);
+	double sum = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (unsigned long long i = 0; i < draws; i++) {
+		sum += network.get_latency(i % edges, i & 1 ? BLOCK_SIZE : TXN_SIZE);
+	}
+	report("get_latency", "edges=" + to_string(edges), draws, seconds_since(start), (unsigned long long) sum);
+}
+
+// the same draws a node's whole edge range at a time, as a broadcast takes them
+void latency_ranges(double scale) {
+	Options options = bench_options(0);
+	Network network(1000, 0.3, options);
+	const LinkTable &links = network.links();
+	unsigned long long target = (unsigned long long) (scale * 20000000), draws = 0;
+	vector<Time> latencies;
+	double sum = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (unsigned long long i = 0; draws < target; i++) {
+		Id node = i % links.nodes();
+		network.get_latencies(node, node, i & 1 ? BLOCK_SIZE : TXN_SIZE, latencies);
+		for (Time latency : latencies) {
+			sum += latency;
+		}
+		draws += latencies.size();
+	}
+	report("get_latencies", "edges=" + to_string(links.edges()), draws, seconds_since(start), (unsigned long long) sum);
+}
+
+// chain of blocks of txnsPerBlock transactions between nodes accounts,
+// block i extends block i - 1 or with forkProbability one of the 8 before it
+vector<BlockNode*> block_tree(ObjectStore &store, size_t blocks, size_t txnsPerBlock, size_t accounts,
+                              double forkProbability, Stream &stream) {
+	vector<BlockNode*> tree;
+	vector<const Transaction*> txns;
+	for (size_t i = 0; i < blocks; i++) {
+		txns.clear();
+		for (size_t t = 0; t < txnsPerBlock; t++) {
+			Id txnId = i * txnsPerBlock + t;
+			txns.push_back(store.shard(0).txns.create(txnId, stream.below(accounts), stream.below(accounts), stream.below(10)));
+		}
+		BlockNode *parent = i > 0 ? tree[i - 1] : store.genesis();
+		if (i > 0 && stream.uniform() < forkProbability) {
+			parent = tree[i - 1 - stream.below(min(i, (size_t) 8))];
+		}
+		tree.push_back(store.create_block(0, GENESIS_ID + 1 + i, parent->id(), txns, parent, i));
+	}
+	return tree;
+}
+
+// a node receiving a block tree with forks in creation order, ledger moves and mempool updates included
+void receive_block(double scale) {
+	size_t blocks = (size_t) (scale * 20000);
+	ObjectStore store(1);
+	Stream stream(1);
+	vector<BlockNode*> tree = block_tree(store, blocks, 20, 1000, 0.2, stream);
+	NodeTable table;
+	table.add(FAST, 1, 1, 1);
+	Node node(0, table, 1000, store.genesis());
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i < tree.size(); i++) {
+		node.receive_block(tree[i], i);
+	}
+	double seconds = seconds_since(start);
+	report("receive_block", "blocks=" + to_string(blocks) + ",txns=20,fork=0.2", blocks, seconds,
+	       node.blockChain().height() ^ node.ledger().reorgs() << 32);
+}
+
+// the orphan path of BlockChain::add_block: every block arrives before its parent
+void orphan_path(double scale) {
+	size_t blocks = (size_t) (scale * 200000);
+	ObjectStore store(1);
+	Stream stream(1);
+	vector<BlockNode*> tree = block_tree(store, blocks, 0, 1, 0.1, stream);
+	reverse(tree.begin(), tree.end());
+	BlockChain chain(store.genesis());
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i < tree.size(); i++) {
+		chain.add_block(tree[i], i);
+	}
+	double seconds = seconds_since(start);
+	report("add_block_orphans", "blocks=" + to_string(blocks) + ",fork=0.1", blocks, seconds, chain.height());
+}
+
+// one node's duplicate checks: the transactions of 1000 creators at rates
+// between 0.5 and 2, each arriving from 8 peers about half a second apart.
+// the digest counts the arrivals taken as new, the transactions themselves
+// for an exact filter
+void seen_filter(double scale) {
+	size_t n = 1000, txns = (size_t) (scale * 200000);
+	Stream stream(1);
+	vector<double> rates(n);
+	vector<unsigned long long> counts(n, 0);
+	priority_queue<pair<Time,size_t>, vector<pair<Time,size_t> >, greater<pair<Time,size_t> > > creations;
+	for (size_t c = 0; c < n; c++) {
+		rates[c] = (500 + stream.below(1500)) / 1000.0;
+		creations.push(make_pair(stream.exponential(rates[c]), c));
+	}
+	vector<pair<Time,Id> > arrivals;
+	for (size_t i = 0; i < txns; i++) {
+		Time created = creations.top().first;
+		size_t c = creations.top().second;
+		creations.pop();
+		creations.push(make_pair(created + stream.exponential(rates[c]), c));
+		Id id = creator_scoped_id(counts[c]++, c, n);
+		for (int d = 0; d < 8; d++) {
+			arrivals.push_back(make_pair(created + stream.exponential(2), id));
+		}
+	}
+	sort(arrivals.begin(), arrivals.end());
+	const char *kinds[] = {"hash", "bitmap", "bloom"};
+	for (const char *kind : kinds) {
+		SeenFilter *filter = make_seen_filter(kind, 20000, 0.000001, 1);
+		unsigned long long fresh = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (const pair<Time,Id> &arrival : arrivals) {
+			if (!filter->contains(arrival.second)) {
+				filter->insert(arrival.second);
+				fresh++;
+			}
+		}
+		double seconds = seconds_since(start);
+		report("seen_filter", string("kind=") + kind + ",txns=" + to_string(txns) + ",peers=8", arrivals.size(), seconds,
+		       fresh, filter->bytes());
+		delete filter;
+	}
+}
+
+// the whole network scans of the summary: state digest, best top and the
+// nodes on its branch, over a network of 10000 nodes at genesis
+void node_scan(double scale) {
+	Options options = bench_options(0);
+	size_t n = 10000;
+	Network network(n, 0.3, options);
+	unsigned long long scans = (unsigned long long) (scale * 2000), digest = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (unsigned long long i = 0; i < scans; i++) {
+		digest += network.digest() + network.nodes_on_branch(network.best_top()).size();
+	}
+	report("node_scan", "n=" + to_string(n), scans * n, seconds_since(start), digest);
+}
+
+// whole runs with the default settings and with batched relay and compact blocks
+void end_to_end(double scale) {
+	const char *modes[] = {"flood,full", "flood,full,lazy", "batch,compact"};
+	for (int m = 0; m < 3; m++) {
+		Options options = bench_options(scale * 20);
+		options.topology = "ba";
+		if (m == 1) {
+			options.delivery = "lazy";
+		} else if (m == 2) {
+			options.relay = "batch";
+			options.blockRelay = "compact";
+		}
+		Network network(200, 0.3, options);
+		network.simulate(numeric_limits<int>::max());
+		const RunStats &stats = network.stats();
+		report("end_to_end", string("n=200,ba,") + modes[m], stats.events, stats.elapsed, network.digest(), network.queued());
+	}
+}
+
+int main(int argc, char **argv) {
+	double scale = argc > 1 ? stod(argv[1]) : 1;
+	string only = argc > 2 ? argv[2] : "";
+	if (scale <= 0) {
+		cout << "Usage: " << argv[0] << " [scale] [benchmark]" << endl;
+		exit(0);
+	}
+	printf("benchmark\tparams\tops\tseconds\tops/sec\tdigest\tsize\n");
+	if (only.empty() || only == "event_loop") {
+		event_loop(scale);
+	}
+	if (only.empty() || only == "get_latency") {
+		latency(scale);
+	}
+	if (only.empty() || only == "get_latencies") {
+		latency_ranges(scale);
+	}
+	if (only.empty() || only == "receive_block") {
+		receive_block(scale);
+	}
+	if (only.empty() || only == "add_block_orphans") {
+		orphan_path(scale);
+	}
+	if (only.empty() || only == "seen_filter") {
+		seen_filter(scale);
+	}
+	if (only.empty() || only == "node_scan") {
+		node_scan(scale);
+	}
+	if (only.empty() || only == "end_to_end") {
+		end_to_end(scale);
+	}
+	return 0;
+}
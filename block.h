@@ -7,36 +7,41 @@
 
 using namespace std;
 
-int blockIdCounter = 1;
+const Id GENESIS_ID = 0; // created blocks get creator scoped ids starting at 1
 
 class Block {
 public:
-    Block(Id parentId, const vector<Transaction> &transactions) : _transactions(transactions) {
-        _id = parentId ? ++blockIdCounter : 1;
+    Block(Id id, Id parentId, const vector<const Transaction*> &transactions, Time created = 0) : _transactions(transactions) {
+        _id = id;
         _parentId = parentId;
+        _created = created;
     }
 
     Id id() const { return _id; }
 
     Id parentId() const { return _parentId; }
 
-    bool has_transaction(Id txnId) {
-        for (Transaction txn : _transactions) {
-            if (txn.id() == txnId) {
+    // simulated time at which the creator mined it
+    Time created() const { return _created; }
+
+    bool has_transaction(Id txnId) const {
+        for (const Transaction *txn : _transactions) {
+            if (txn->id() == txnId) {
                 return true;
             }
         }
         return false;
     }
 
-    vector<Transaction>& transactions() {
+    const vector<const Transaction*>& transactions() const {
     	return _transactions;
     }
 
 private:
     Id _id;
     Id _parentId;
-    vector<Transaction> _transactions;
+    Time _created;
+    vector<const Transaction*> _transactions; // owned by the ObjectStore
 };
 
 #endif // BLOCK_H
\ No newline at end of file
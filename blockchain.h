@@ -1,47 +1,74 @@
 #ifndef BLOCKCHAIN_H
 #define BLOCKCHAIN_H
 
-#include <map>
 #include <queue>
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
 #include "blocknode.h"
 #include "transaction.h"
+#include "snapshot.h"
 
 using namespace std;
 
+// one node's view of the shared block tree: which blocks it has connected,
+// when they arrived, its top and the blocks still waiting for their parent.
+// the tree structure itself lives once in the BlockNodes of the ObjectStore.
 class BlockChain {
 public:
-	BlockChain() {
-		vector<Transaction> txns;
-		Block genesisBlock(0, txns);
-		_top = new BlockNode(genesisBlock, NULL, 0);
-		_blockMap[genesisBlock.id()] = _top;
+	BlockChain(BlockNode *genesis) : _top(genesis), _orphanCount(0), _maxOrphans(0),
+		_maxOrphanAge(numeric_limits<Time>::infinity()), _orphansExpired(0)
+	{
+		connect(genesis, 0);
 	}
 
 	unsigned long height() const { return _top->height(); }
 
 	BlockNode *top() const { return _top; }
 
+	// drops orphans once more than maxOrphans are held or once they have
+	// waited longer than maxAge for their parent. 0 and infinity disable the
+	// respective limit. a dropped orphan is never connected later.
+	void limit_orphans(size_t maxOrphans, Time maxAge) {
+		_maxOrphans = maxOrphans;
+		_maxOrphanAge = maxAge;
+	}
+
 	// adds a block to the blockchain
 	// returns true if succesful
 	// returns false if parent block not in blockchain
-	bool add_block(Block &block, Time arrivalTime) {
-		if (_blockMap.find(block.parentId()) == _blockMap.end()) {
-			_orphanBlocks.push_back(block);
-			_orphanArrivalTimes.push_back(arrivalTime);
+	bool add_block(BlockNode *block, Time arrivalTime) {
+		expire_orphans(arrivalTime);
+		if (!contains(block->parentNode())) {
+			Orphan orphan = {block, arrivalTime};
+			_orphans[block->parentNode()->id()].push_back(orphan);
+			_orphanCount++;
+			if (_maxOrphans > 0 || _maxOrphanAge < numeric_limits<Time>::infinity()) {
+				_orphanQueue.push_back(orphan);
+				expire_orphans(arrivalTime);
+			}
 			return false;
 		} else {
-			add_blockNode(block, block.parentId(), arrivalTime);
-			// check if new added block is parent of any orphan block
+			connect(block, arrivalTime);
+			// connect the orphans waiting for the new block, and theirs in turn
 			queue<Id> q;
-			q.push(block.id());
+			q.push(block->id());
 			while (!q.empty()) {
 				Id parentId = q.front();
 				q.pop();
-				int index;
-				while ((index = is_parent_of_orphan(parentId)) >= 0) {
-					add_blockNode(_orphanBlocks[index], parentId, _orphanArrivalTimes[index]);
-					q.push(_orphanBlocks[index].id());
-					remove_orphan_block(index);
+				unordered_map<Id,vector<Orphan> >::iterator it = _orphans.find(parentId);
+				if (it == _orphans.end()) {
+					continue;
+				}
+				vector<Orphan> children;
+				children.swap(it->second);
+				_orphans.erase(it);
+				for (const Orphan &orphan : children) {
+					connect(orphan.block, orphan.arrivalTime);
+					q.push(orphan.block->id());
+					_orphanCount--;
 				}
 			}
 
@@ -50,38 +77,203 @@ public:
 
 	}
 
-	map<Id,BlockNode*>& blockMap() { return _blockMap; }
+	// the block is connected to this blockchain
+	bool contains(const BlockNode *block) const {
+		uint32_t i = block->index();
+		return i / 64 < _connected.size() && (_connected[i / 64] >> (i % 64) & 1);
+	}
+
+	// time at which a connected block arrived at this node
+	Time arrival_time(const BlockNode *block) const { return _arrivalTimes[block->index()]; }
+
+	// calls f(index) for every connected block in increasing index order
+	template <typename F>
+	void for_each_block(F f) const {
+		for (size_t w = 0; w < _connected.size(); w++) {
+			for (uint64_t bits = _connected[w]; bits != 0; bits &= bits - 1) {
+				f((uint32_t) (w * 64 + __builtin_ctzll(bits)));
+			}
+		}
+	}
+
+	// bytes held by the connected set and the arrival times
+	size_t bytes() const { return _connected.capacity() * sizeof(uint64_t) + _arrivalTimes.capacity() * sizeof(Time); }
+
+	// orphans currently waiting for their parent
+	size_t orphans() const { return _orphanCount; }
+
+	// orphans dropped by the limits so far
+	unsigned long long orphans_expired() const { return _orphansExpired; }
+
+	// follows a pruning of the shared tree: the block state moves to the new
+	// index remap gives each old one, NO_INDEX for a freed block, and the
+	// orphans which can no longer connect are dropped
+	void reindex(const vector<uint32_t> &remap) {
+		vector<uint64_t> connected;
+		vector<Time> arrivalTimes;
+		for_each_block([&](uint32_t i) {
+			uint32_t j = remap[i];
+			if (j == NO_INDEX) {
+				return;
+			}
+			if (j / 64 >= connected.size()) {
+				connected.resize(j / 64 + 1, 0);
+			}
+			if (j >= arrivalTimes.size()) {
+				arrivalTimes.resize(j + 1);
+			}
+			connected[j / 64] |= 1ULL << (j % 64);
+			arrivalTimes[j] = _arrivalTimes[i];
+		});
+		connected.shrink_to_fit();
+		arrivalTimes.shrink_to_fit();
+		_connected.swap(connected);
+		_arrivalTimes.swap(arrivalTimes);
+
+		_orphanCount = 0;
+		for (unordered_map<Id,vector<Orphan> >::iterator it = _orphans.begin(); it != _orphans.end(); ) {
+			vector<Orphan> &siblings = it->second;
+			siblings.erase(remove_if(siblings.begin(), siblings.end(), [&remap](const Orphan &orphan) {
+				return remap[orphan.block->index()] == NO_INDEX || orphan.block->detached();
+			}), siblings.end());
+			_orphanCount += siblings.size();
+			it = siblings.empty() ? _orphans.erase(it) : ++it;
+		}
+		_orphanQueue.erase(remove_if(_orphanQueue.begin(), _orphanQueue.end(), [&remap](const Orphan &orphan) {
+			return remap[orphan.block->index()] == NO_INDEX || orphan.block->detached();
+		}), _orphanQueue.end());
+	}
+
+	// the orphan limits are not part of the snapshot, they are set again
+	void save(SnapshotWriter &out) const {
+		out.put_block(_top);
+		out.put_vector(_connected);
+		out.put_vector(_arrivalTimes);
+		out.put((uint64_t) _orphans.size());
+		for (const pair<const Id,vector<Orphan> > &waiting : _orphans) {
+			out.put((uint64_t) waiting.second.size());
+			for (const Orphan &orphan : waiting.second) {
+				save_orphan(out, orphan);
+			}
+		}
+		out.put((uint64_t) _orphanQueue.size());
+		for (const Orphan &orphan : _orphanQueue) {
+			save_orphan(out, orphan);
+		}
+		out.put((uint64_t) _orphanCount);
+		out.put(_orphansExpired);
+	}
+
+	void load(SnapshotReader &in) {
+		_top = in.get_block();
+		in.get_vector(_connected);
+		in.get_vector(_arrivalTimes);
+		_orphans.clear();
+		for (uint64_t i = in.get<uint64_t>(); i > 0 && in.ok(); i--) {
+			for (uint64_t j = in.get<uint64_t>(); j > 0 && in.ok(); j--) {
+				Orphan orphan = load_orphan(in);
+				if (!in.ok()) {
+					break;
+				}
+				_orphans[orphan.block->parentNode()->id()].push_back(orphan);
+			}
+		}
+		_orphanQueue.clear();
+		for (uint64_t i = in.get<uint64_t>(); i > 0 && in.ok(); i--) {
+			_orphanQueue.push_back(load_orphan(in));
+		}
+		_orphanCount = in.get<uint64_t>();
+		_orphansExpired = in.get<unsigned long long>();
+		size_t times = _arrivalTimes.size();
+		for_each_block([&in, times](uint32_t i) {
+			if (i >= times) {
+				in.fail("bad blockchain");
+			}
+		});
+	}
 
 private:
+	struct Orphan {
+		BlockNode *block;
+		Time arrivalTime;
+	};
+
 	BlockNode *_top;
-	map<Id,BlockNode*> _blockMap; // use unordered_map instead
-	vector<Block> _orphanBlocks; // block whose parent block is missing in blockchain
-	vector<Time> _orphanArrivalTimes;
-
-	int is_parent_of_orphan(Id blockId) {
-		for (int index = 0; index < _orphanBlocks.size(); index++) {
-			if (_orphanBlocks[index].parentId() == blockId) {
-				return index;
+	vector<uint64_t> _connected; // bitset over tree node indexes, the blocks this node has connected
+	vector<Time> _arrivalTimes; // by tree node index, valid for connected blocks
+	unordered_map<Id,vector<Orphan> > _orphans; // blocks whose parent is missing, by parent id
+	deque<Orphan> _orphanQueue; // orphans by arrival if limited, may hold ones connected since
+	size_t _orphanCount;
+	size_t _maxOrphans;
+	Time _maxOrphanAge;
+	unsigned long long _orphansExpired;
+
+	// returns false if the orphan has been connected already, removes it if drop
+	bool find_orphan(BlockNode *block, bool drop) {
+		unordered_map<Id,vector<Orphan> >::iterator it = _orphans.find(block->parentNode()->id());
+		if (it == _orphans.end()) {
+			return false;
+		}
+		vector<Orphan> &siblings = it->second;
+		for (size_t i = 0; i < siblings.size(); i++) {
+			if (siblings[i].block == block) {
+				if (drop) {
+					siblings.erase(siblings.begin() + i);
+					if (siblings.empty()) {
+						_orphans.erase(it);
+					}
+				}
+				return true;
 			}
 		}
-		return -1;
+		return false;
+	}
+
+	static void save_orphan(SnapshotWriter &out, const Orphan &orphan) {
+		out.put_block(orphan.block);
+		out.put(orphan.arrivalTime);
 	}
 
-	void remove_orphan_block(int index) {
-		_orphanBlocks[index] = _orphanBlocks.back();
-		_orphanBlocks.pop_back();
-		_orphanArrivalTimes[index] = _orphanArrivalTimes.back();
-		_orphanArrivalTimes.pop_back();
+	static Orphan load_orphan(SnapshotReader &in) {
+		Orphan orphan = {in.get_block(), 0};
+		orphan.arrivalTime = in.get<Time>();
+		if (orphan.block->parentNode() == NULL) {
+			in.fail("bad orphan");
+		}
+		return orphan;
 	}
 
-	void add_blockNode(Block &block, Id parentId, Time arrivalTime) {
-		BlockNode *parentNode = _blockMap[parentId];
-		BlockNode *bnode = new BlockNode(block, parentNode, arrivalTime);
-		_blockMap[block.id()] = bnode;
+	// drops the oldest orphans while a limit is exceeded. connected orphans
+	// reaching the front of the queue are discarded on the way
+	void expire_orphans(Time now) {
+		while (!_orphanQueue.empty()) {
+			const Orphan &oldest = _orphanQueue.front();
+			bool expired = (_maxOrphans > 0 && _orphanCount > _maxOrphans) || now - oldest.arrivalTime > _maxOrphanAge;
+			if (find_orphan(oldest.block, expired)) {
+				if (!expired) {
+					break;
+				}
+				_orphanCount--;
+				_orphansExpired++;
+			}
+			_orphanQueue.pop_front();
+		}
+	}
+
+	void connect(BlockNode *block, Time arrivalTime) {
+		uint32_t i = block->index();
+		if (i / 64 >= _connected.size()) {
+			_connected.resize(i / 64 + 1, 0);
+		}
+		if (i >= _arrivalTimes.size()) {
+			_arrivalTimes.resize(i + 1);
+		}
+		_connected[i / 64] |= 1ULL << (i % 64);
+		_arrivalTimes[i] = arrivalTime;
 
 		// update top if this becomes the longest chain
-		if (bnode->height() > _top->height()) {
-			_top = bnode;
+		if (block->height() > _top->height()) {
+			_top = block;
 		}
 	}
 };
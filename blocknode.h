@@ -1,28 +1,112 @@
 #ifndef BLOCKNODE_H
 #define BLOCKNODE_H
 
+#include <vector>
+#include <stdint.h>
 #include "block.h"
 
+using namespace std;
+
+const uint32_t NO_INDEX = 0xffffffff; // a tree node freed by a pruning
+
+// a block's place in the block tree shared by all nodes. created once by the
+// block's creator, every node's BlockChain refers to it. once the tree is
+// pruned below a final block, that block is the root and has no parent, and
+// the blocks still kept that do not descend from it are detached
 class BlockNode {
 public:
-	BlockNode(Block block, BlockNode *parentNode, Time arrivalTime) : 
-		_block(block), _parentNode(parentNode), _arrivalTime(arrivalTime)
+	// height only counts for a block without parent
+	BlockNode(const Block *block, BlockNode *parentNode, uint32_t index, unsigned long height = 1) :
+		_block(block), _parentNode(parentNode), _skipNode(NULL), _index(index), _validated(false), _detached(false)
 	{
-		_height = parentNode ? _parentNode->height() + 1 : 1;
+		_height = parentNode ? _parentNode->height() + 1 : height;
+		if (parentNode) {
+			_skipNode = parentNode->ancestor(skip_height(_height));
+		}
 	}
 
 	unsigned long height() const { return _height; }
 
 	BlockNode* parentNode() const { return _parentNode; }
 
-	Time arrivalTime() const { return _arrivalTime; }
+	const Block& block() const { return *_block; }
+
+	Id id() const { return _block->id(); }
+
+	// dense position among all tree nodes, in creation order
+	uint32_t index() const { return _index; }
+
+	void set_index(uint32_t index) { _index = index; }
+
+	// ancestor at the given height (at most this node's height) in O(log height)
+	// steps, NULL if that is below the root. the skip pointers follow the
+	// scheme of bitcoin core's CBlockIndex
+	BlockNode* ancestor(unsigned long height) {
+		BlockNode *walk = this;
+		while (walk != NULL && walk->_height > height) {
+			unsigned long skip = skip_height(walk->_height);
+			unsigned long skipPrev = skip_height(walk->_height - 1);
+			if (walk->_skipNode != NULL && (skip == height ||
+			    (skip > height && !(skipPrev + 2 < skip && skipPrev >= height)))) {
+				walk = walk->_skipNode;
+			} else {
+				walk = walk->_parentNode;
+			}
+		}
+		return walk;
+	}
+
+	// indexes of the block's transactions the ledger rejected. the first ledger
+	// to apply the block, its creator's, decides and marks it validated
+	vector<uint32_t>& rejected() { return _rejected; }
+
+	bool validated() const { return _validated; }
 
-	Block block() const { return _block; }
+	void set_validated() { _validated = true; }
+
+	// the block's branch left the tree in a pruning, no node can connect it
+	bool detached() const { return _detached; }
+
+	// also forgets the parent if it is about to be freed
+	void detach(bool dropParent) {
+		_detached = true;
+		_skipNode = NULL;
+		if (dropParent) {
+			_parentNode = NULL;
+		}
+	}
+
+	// drops the links to ancestors below height, which are about to be freed
+	void cut_below(unsigned long height) {
+		if (_parentNode != NULL && _height - 1 < height) {
+			_parentNode = NULL;
+		}
+		if (_skipNode != NULL && skip_height(_height) < height) {
+			_skipNode = NULL;
+		}
+	}
 private:
-	Block _block;
+	const Block *_block; // owned by the ObjectStore
 	unsigned long _height;
 	BlockNode *_parentNode;
-	Time _arrivalTime;
+	BlockNode *_skipNode; // ancestor at skip_height(_height)
+	uint32_t _index;
+	bool _validated;
+	bool _detached;
+	vector<uint32_t> _rejected;
+
+	static unsigned long clear_lowest_one(unsigned long n) { return n & (n - 1); }
+
+	// height of the skip target. spaced so that any ancestor is reached in a
+	// logarithmic number of skip and parent steps. heights start at 1
+	static unsigned long skip_height(unsigned long height) {
+		unsigned long level = height - 1;
+		if (level < 2) {
+			return 1;
+		}
+		level = (level & 1) ? clear_lowest_one(clear_lowest_one(level - 1)) + 1 : clear_lowest_one(level);
+		return level + 1;
+	}
 };
 
-#endif // BLOCKNODE_H
\ No newline at end of file
+#endif // BLOCKNODE_H
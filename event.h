@@ -1,58 +1,97 @@
 #ifndef EVENT_H
 #define EVENT_H
 
+#include <vector>
 #include "transaction.h"
-#include "block.h"
+#include "blocknode.h"
 #include "types.h"
 
+using namespace std;
+
 const int CREATE_TRANSACTION = 0;
 const int CREATE_BLOCK = 1;
 const int RECEIVE_TRANSACTION = 2;
 const int RECEIVE_BLOCK = 3;
+const int RELAY_FLUSH = 4; // batched relay: send the node's buffered transactions
+const int RECEIVE_INVENTORY = 5; // batched relay: a batch of transactions from a peer
+const int RECEIVE_BLOCK_TXNS = 6; // compact blocks: the transactions missing from a compact block arrived
+const int FANOUT = 7; // lazy delivery: the next of a broadcast's deliveries, never dispatched itself
+
+struct Fanout;
 
-class Event {
-public:
-	Event(Time occurenceTime, EventType eventType, Transaction *txn, Block *block,
-			Id senderId, Id receiverId, Id creatorId) 
-	{
-		_occurenceTime = occurenceTime;
-		_eventType = eventType;
-		_txn = txn;
-		_block = block;
-		_senderId = senderId;
-		_receiverId = receiverId;
-		_creatorId = creatorId;
-	}
-
-	Time occurenceTime() const { return _occurenceTime; }
-
-	EventType type() const { return _eventType; }
-
-	Transaction* txn() const { return _txn; }
-
-	Block* block() const { return _block; }
-
-	Id senderId() const { return _senderId; }
-
-	Id receiverId() const { return _receiverId; }
-
-	Id creatorId() const { return _creatorId; }
-	
-private:
-	Time _occurenceTime; // global time at which event occurs
-	EventType _eventType; // type of the event
-	Transaction *_txn; // not NULL for RECEIVE_TRANSACTION event
-	Block *_block; // not NULL for RECEIVE_BLOCK event
-	Id _senderId; // id of the node creating RECEIVE_* event
-	Id _receiverId; // id of the node which is receiving RECEIVE_* event
-	Id _creatorId;	// id of the node which has created the CREATE_* event
+// plain event record, copied by value into the scheduler's slab
+struct Event {
+	Time time; // global time at which event occurs
+	EventType type; // type of the event
+	Id node; // node at which the event occurs (creator of CREATE_*, receiver of RECEIVE_*)
+	Id peer; // node which has sent the RECEIVE_* event
+	union {
+		const Transaction *txn; // RECEIVE_TRANSACTION payload
+		BlockNode *block; // RECEIVE_BLOCK(_TXNS) payload, the block's node in the shared tree
+		vector<const Transaction*> *txns; // RECEIVE_INVENTORY payload, owned by the event
+		Fanout *fanout; // FANOUT payload, owned by the partition
+	};
 };
 
-class EventComparison {
-public:
-	bool operator() (const Event *lhs, const Event *rhs) const {
-		return lhs->occurenceTime() > rhs->occurenceTime();
-	}
+// one receiver of a broadcast, with the time and tie breaking key its own
+// event would have had
+struct Delivery {
+	Time time;
+	uint64_t key;
+	Id node;
+};
+
+inline bool earlier_delivery(const Delivery &lhs, const Delivery &rhs) {
+	return lhs.time < rhs.time || (lhs.time == rhs.time && lhs.key < rhs.key);
+}
+
+// the pending deliveries of a broadcast in arrival order. a single FANOUT
+// event in the queue stands for all of them, keyed by the next one, so the
+// deliveries come out in exactly the order separate events would
+struct Fanout {
+	Event event; // the received event, without time and receiver
+	vector<Delivery> deliveries;
+	size_t next; // first delivery not made yet
 };
 
-#endif //EVENT_H
\ No newline at end of file
+inline Event create_event(Time time, EventType type, Id creatorId) {
+	Event event;
+	event.time = time;
+	event.type = type;
+	event.node = creatorId;
+	event.peer = -1;
+	event.txn = NULL;
+	return event;
+}
+
+inline Event receive_txn_event(Time time, const Transaction *txn, Id senderId, Id receiverId) {
+	Event event;
+	event.time = time;
+	event.type = RECEIVE_TRANSACTION;
+	event.node = receiverId;
+	event.peer = senderId;
+	event.txn = txn;
+	return event;
+}
+
+inline Event receive_block_event(Time time, BlockNode *block, Id senderId, Id receiverId) {
+	Event event;
+	event.time = time;
+	event.type = RECEIVE_BLOCK;
+	event.node = receiverId;
+	event.peer = senderId;
+	event.block = block;
+	return event;
+}
+
+inline Event receive_inventory_event(Time time, vector<const Transaction*> *txns, Id senderId, Id receiverId) {
+	Event event;
+	event.time = time;
+	event.type = RECEIVE_INVENTORY;
+	event.node = receiverId;
+	event.peer = senderId;
+	event.txns = txns;
+	return event;
+}
+
+#endif //EVENT_H
@@ -0,0 +1,119 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <stdint.h>
+#include "types.h"
+#include "rng.h"
+#include "links.h"
+
+using namespace std;
+
+const double QUEUE_DELAY_MB = 0.12; // mean queuing delay is 0.12 Mb over the link bandwidth
+
+// rounding step of a --latency mode: whole seconds, milliseconds or none
+inline double latency_resolution(const string &mode) {
+	return mode == "floor" ? 1 : mode == "ms" ? 0.001 : 0;
+}
+
+// latency of a message on a directed edge: propagation delay, transfer time
+// and an exponential queuing delay drawn from the edge's own counter based
+// stream. the stream keys and counters are kept in arrays parallel to the
+// link table along with the per edge constants, so a broadcast samples a
+// node's whole edge range in one pass over contiguous memory. a range draw
+// gives exactly the values one draw per edge would.
+class LatencyModel {
+public:
+	LatencyModel() : _resolution(0) {}
+
+	// resolution is the step latencies are rounded down to, 0 for none
+	void build(const LinkTable &links, uint64_t seed, double resolution) {
+		vector<uint64_t> keys, counters(links.edges(), 0);
+		for (size_t e = 0; e < links.edges(); e++) {
+			keys.push_back(stream_key(seed, LINK_STREAM, e));
+		}
+		restore(links, keys, counters, resolution);
+	}
+
+	// continues the streams after the given number of draws
+	void restore(const LinkTable &links, const vector<uint64_t> &keys, const vector<uint64_t> &counters, double resolution) {
+		_resolution = resolution;
+		_keys = keys;
+		_counters = counters;
+		_propDelays.resize(links.edges());
+		_bandwidths.resize(links.edges());
+		_queueRates.resize(links.edges());
+		for (size_t e = 0; e < links.edges(); e++) {
+			_propDelays[e] = links.prop_delay(e);
+			_bandwidths[e] = links.bandwidth(e);
+			_queueRates[e] = links.bandwidth(e) / QUEUE_DELAY_MB;
+		}
+	}
+
+	Time sample(size_t edge, int size_m) {
+		double u = uniform(mix64(_keys[edge] + ++_counters[edge] * GOLDEN_GAMMA));
+		return round(_propDelays[edge] + (size_m / _bandwidths[edge]) + -std::log(u) / _queueRates[edge]);
+	}
+
+	// latencies of a message of size_m on the edges [begin, end) into
+	// out[0 .. end - begin). skip is left out, its stream does not advance
+	// and its entry is meaningless; pass end to draw on every edge.
+	// the counters and uniforms are computed without branches first, so the
+	// integer mixing can be vectorized, then the logarithms
+	void sample_range(size_t begin, size_t end, size_t skip, int size_m, vector<Time> &out) {
+		size_t count = end - begin;
+		out.resize(count);
+		uint64_t *keys = &_keys[0] + begin;
+		uint64_t *counters = &_counters[0] + begin;
+		for (size_t i = 0; i < count; i++) {
+			counters[i] += begin + i != skip;
+			out[i] = uniform(mix64(keys[i] + counters[i] * GOLDEN_GAMMA));
+		}
+		const double *propDelays = &_propDelays[0] + begin;
+		const double *bandwidths = &_bandwidths[0] + begin;
+		const double *queueRates = &_queueRates[0] + begin;
+		for (size_t i = 0; i < count; i++) {
+			out[i] = propDelays[i] + (size_m / bandwidths[i]) + -std::log(out[i]) / queueRates[i];
+		}
+		if (_resolution > 0) {
+			for (size_t i = 0; i < count; i++) {
+				out[i] = floor(out[i] / _resolution) * _resolution;
+			}
+		}
+	}
+
+	// lower bound on any latency, the lookahead of the parallel engine
+	Time min_latency() const {
+		Time least = numeric_limits<double>::infinity();
+		for (double delay : _propDelays) {
+			least = min(least, round(delay));
+		}
+		return least;
+	}
+
+	const vector<uint64_t>& keys() const { return _keys; }
+
+	const vector<uint64_t>& counters() const { return _counters; }
+
+private:
+	double _resolution;
+	vector<uint64_t> _keys; // stream of each edge
+	vector<uint64_t> _counters; // draws taken on each edge
+	vector<double> _propDelays; // seconds
+	vector<double> _bandwidths; // Mbps
+	vector<double> _queueRates; // rate of the exponential queuing delay
+
+	// uniform in (0, 1] like Stream::uniform
+	static double uniform(uint64_t bits) {
+		return (bits >> 11) * (1.0 / 9007199254740992.0) + (1.0 / 9007199254740992.0);
+	}
+
+	Time round(double latency) const {
+		return _resolution > 0 ? floor(latency / _resolution) * _resolution : latency;
+	}
+};
+
+#endif // LATENCY_H
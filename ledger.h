@@ -0,0 +1,201 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "types.h"
+#include "transaction.h"
+#include "blocknode.h"
+#include "mempool.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// account balances and confirmed transactions as of one block of a node's
+// blockchain, normally its top. moving to another block undoes the blocks
+// back to the common ancestor and applies the ones down the other branch, so
+// a tip switch costs O(reorg depth). confirmed transactions leave the
+// mempool and undone ones return to it.
+class Ledger {
+public:
+	Ledger(Coin initialBalance) : _initialBalance(initialBalance), _tip(NULL),
+		_reorgs(0), _undone(0) {}
+
+	BlockNode* tip() const { return _tip; }
+
+	Coin balance(Id account) const {
+		unordered_map<Id,Coin>::const_iterator it = _balances.find(account);
+		return it == _balances.end() ? _initialBalance : it->second;
+	}
+
+	bool confirmed(Id txnId) const { return _confirmed.count(txnId); }
+
+	// a transaction is valid if it is not confirmed yet and the payer can pay it
+	bool valid(const Transaction *txn) const {
+		return !confirmed(txn->id()) && txn->amount() >= 0 && txn->amount() <= balance(txn->payer());
+	}
+
+	// keeps the transactions that are valid when applied in order on the tip
+	void filter_valid(vector<const Transaction*> &txns) {
+		_pending.clear();
+		_batch.clear();
+		size_t kept = 0;
+		for (size_t i = 0; i < txns.size(); i++) {
+			const Transaction *txn = txns[i];
+			Coin available = balance(txn->payer()) + _pending[txn->payer()];
+			if (confirmed(txn->id()) || txn->amount() < 0 || txn->amount() > available ||
+			    !_batch.insert(txn->id()).second) {
+				continue;
+			}
+			_pending[txn->payer()] -= txn->amount();
+			_pending[txn->payee()] += txn->amount();
+			txns[kept++] = txn;
+		}
+		txns.resize(kept);
+	}
+
+	// moves the ledger to target, a block of the same blockchain
+	void move_to(BlockNode *target, Mempool &mempool) {
+		if (_tip == NULL) {
+			// start at the root of the tree, genesis unless it was pruned
+			for (_tip = target; _tip->parentNode() != NULL; _tip = _tip->parentNode()) {}
+		}
+		BlockNode *from = _tip;
+		BlockNode *to = target;
+		if (from->height() > to->height()) {
+			from = from->ancestor(to->height());
+		} else {
+			to = to->ancestor(from->height());
+		}
+		while (from != to) {
+			from = from->parentNode();
+			to = to->parentNode();
+		}
+		BlockNode *fork = from;
+		if (fork != _tip) {
+			_reorgs++;
+		}
+		while (_tip != fork) {
+			undo(_tip, mempool);
+			_tip = _tip->parentNode();
+			_undone++;
+		}
+		_path.clear();
+		for (BlockNode *node = target; node != fork; node = node->parentNode()) {
+			_path.push_back(node);
+		}
+		for (size_t i = _path.size(); i-- > 0; ) {
+			apply(_path[i], mempool);
+		}
+		_tip = target;
+	}
+
+	// forgets transactions of final blocks which nothing refers to anymore
+	void forget(const vector<Id> &txnIds) {
+		for (Id id : txnIds) {
+			_confirmed.erase(id);
+		}
+	}
+
+	// tip switches that left the previous tip's branch
+	unsigned long long reorgs() const { return _reorgs; }
+
+	// blocks undone by those switches
+	unsigned long long undone() const { return _undone; }
+
+	void save(SnapshotWriter &out) const {
+		out.put(_initialBalance);
+		out.put((uint64_t) _balances.size());
+		for (const pair<const Id,Coin> &balance : _balances) {
+			out.put(balance.first);
+			out.put(balance.second);
+		}
+		out.put_vector(vector<Id>(_confirmed.begin(), _confirmed.end()));
+		out.put_block(_tip);
+		out.put(_reorgs);
+		out.put(_undone);
+	}
+
+	void load(SnapshotReader &in) {
+		_initialBalance = in.get<Coin>();
+		_balances.clear();
+		for (uint64_t i = in.get<uint64_t>(); i > 0 && in.ok(); i--) {
+			Id account = in.get<Id>();
+			_balances[account] = in.get<Coin>();
+		}
+		vector<Id> confirmed;
+		in.get_vector(confirmed);
+		_confirmed.clear();
+		_confirmed.insert(confirmed.begin(), confirmed.end());
+		_tip = in.get_block();
+		_reorgs = in.get<unsigned long long>();
+		_undone = in.get<unsigned long long>();
+	}
+
+private:
+	Coin _initialBalance;
+	unordered_map<Id,Coin> _balances; // accounts touched by a transaction so far
+	unordered_set<Id> _confirmed; // transactions in the blocks up to the tip
+	BlockNode *_tip;
+	vector<BlockNode*> _path; // scratch space of move_to
+	unordered_map<Id,Coin> _pending; // scratch space of filter_valid, balance changes
+	unordered_set<Id> _batch; // scratch space of filter_valid, transactions kept
+	unsigned long long _reorgs;
+	unsigned long long _undone;
+
+	// sign 1 applies the transfer, -1 reverts it
+	void transfer(const Transaction *txn, int sign) {
+		if (txn->payer() == txn->payee()) {
+			return;
+		}
+		unordered_map<Id,Coin>::iterator payer = _balances.insert(make_pair(txn->payer(), _initialBalance)).first;
+		payer->second -= sign * txn->amount();
+		unordered_map<Id,Coin>::iterator payee = _balances.insert(make_pair(txn->payee(), _initialBalance)).first;
+		payee->second += sign * txn->amount();
+	}
+
+	// invalid transactions are skipped. the first ledger to apply a block keeps
+	// their indexes in the shared node, later ones follow that decision so all
+	// nodes agree on a block's effect. that first ledger is the creator's, which
+	// applies the block before it is relayed, so other partitions only read the
+	// shared node
+	void apply(BlockNode *node, Mempool &mempool) {
+		const vector<const Transaction*> &txns = node->block().transactions();
+		vector<uint32_t> &rejected = node->rejected();
+		bool decided = node->validated();
+		size_t r = 0;
+		for (size_t i = 0; i < txns.size(); i++) {
+			if (decided ? r < rejected.size() && rejected[r] == i : !valid(txns[i])) {
+				if (!decided) {
+					rejected.push_back(i);
+				}
+				r++;
+				continue;
+			}
+			transfer(txns[i], 1);
+			_confirmed.insert(txns[i]->id());
+			mempool.remove(txns[i]->id());
+		}
+		if (!decided) {
+			node->set_validated();
+		}
+	}
+
+	void undo(BlockNode *node, Mempool &mempool) {
+		const vector<const Transaction*> &txns = node->block().transactions();
+		const vector<uint32_t> &rejected = node->rejected();
+		size_t r = rejected.size();
+		for (size_t i = txns.size(); i-- > 0; ) {
+			if (r > 0 && rejected[r - 1] == i) {
+				r--;
+				continue;
+			}
+			transfer(txns[i], -1);
+			_confirmed.erase(txns[i]->id());
+			mempool.insert(txns[i]);
+		}
+	}
+};
+
+#endif // LEDGER_H
@@ -0,0 +1,109 @@
+#ifndef LINKS_H
+#define LINKS_H
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include "types.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// undirected edge between two peers
+struct Link {
+	Id a;
+	Id b;
+	double propDelay; // seconds
+	double bandwidth; // Mbps
+};
+
+// peer graph in compressed sparse row form. the out-edges of node i are the
+// edge indices [begin(i), end(i)), and every edge keeps its link attributes
+// in arrays parallel to the neighbor array, so memory is O(n + E) and a
+// broadcast walks contiguous memory.
+class LinkTable {
+public:
+	LinkTable() : _offsets(1, 0) {}
+
+	// replaces the graph, every link becomes an edge in both directions
+	void build(size_t n, const vector<Link> &links) {
+		_offsets.assign(n + 1, 0);
+		for (const Link &link : links) {
+			_offsets[link.a + 1]++;
+			_offsets[link.b + 1]++;
+		}
+		for (size_t i = 0; i < n; i++) {
+			_offsets[i + 1] += _offsets[i];
+		}
+		size_t m = _offsets[n];
+		_nbrs.resize(m);
+		_propDelays.resize(m);
+		_bandwidths.resize(m);
+		vector<size_t> next(_offsets.begin(), _offsets.end() - 1);
+		for (const Link &link : links) {
+			place(next[link.a]++, link.b, link);
+			place(next[link.b]++, link.a, link);
+		}
+	}
+
+	size_t nodes() const { return _offsets.size() - 1; }
+
+	size_t edges() const { return _nbrs.size(); }
+
+	size_t begin(Id node) const { return _offsets[node]; }
+
+	size_t end(Id node) const { return _offsets[node + 1]; }
+
+	size_t degree(Id node) const { return end(node) - begin(node); }
+
+	Id neighbor(size_t edge) const { return _nbrs[edge]; }
+
+	double prop_delay(size_t edge) const { return _propDelays[edge]; }
+
+	double bandwidth(size_t edge) const { return _bandwidths[edge]; }
+
+	// the arrays are saved as they are, so edge indexes and the link streams
+	// keyed by them stay the same
+	void save(SnapshotWriter &out) const {
+		out.put_vector(_offsets);
+		out.put_vector(_nbrs);
+		out.put_vector(_propDelays);
+		out.put_vector(_bandwidths);
+	}
+
+	void load(SnapshotReader &in, size_t n) {
+		in.get_vector(_offsets);
+		in.get_vector(_nbrs);
+		in.get_vector(_propDelays);
+		in.get_vector(_bandwidths);
+		bool valid = _offsets.size() == n + 1 && _offsets[0] == 0 && _offsets[n] == _nbrs.size() &&
+		             _propDelays.size() == _nbrs.size() && _bandwidths.size() == _nbrs.size();
+		for (size_t i = 0; valid && i < n; i++) {
+			valid = _offsets[i] <= _offsets[i + 1];
+		}
+		for (size_t e = 0; valid && e < _nbrs.size(); e++) {
+			valid = _nbrs[e] < n;
+		}
+		if (!valid) {
+			in.fail("bad link table");
+			_offsets.assign(n + 1, 0);
+			_nbrs.clear();
+			_propDelays.clear();
+			_bandwidths.clear();
+		}
+	}
+
+private:
+	vector<size_t> _offsets; // n + 1 offsets into the edge arrays
+	vector<uint32_t> _nbrs;
+	vector<double> _propDelays;
+	vector<double> _bandwidths;
+
+	void place(size_t edge, Id nbr, const Link &link) {
+		_nbrs[edge] = nbr;
+		_propDelays[edge] = link.propDelay;
+		_bandwidths[edge] = link.bandwidth;
+	}
+};
+
+#endif // LINKS_H
@@ -1,20 +1,69 @@
 #include <iostream>
 #include "network.h"
+#include "sweep.h"
 
 using namespace std;
 
 int main(int argc, char **argv) {
-	if (argc != 4) {
-		cout << "Usage: " << argv[0] << " [no. of nodes] [z] [Max no. of events]" << endl;
+	if (argc > 1 && string(argv[1]) == "sweep") {
+		Sweep sweep;
+		if (!sweep.parse(argc, argv)) {
+			cout << "Usage: " << argv[0] << " sweep [n list] [z list] [Max no. of events] [--txn-rate=list]"
+			     << " [--block-rate=list] [--replications=k] [--jobs=j] [--key=value ...]" << endl;
+			exit(0);
+		}
+		sweep.run();
+		return 0;
+	}
+
+	if (argc > 1 && string(argv[1]) == "resume") {
+		Options options;
+		if (argc < 4 || !parse_options(argc, argv, 4, options)) {
+			cout << "Usage: " << argv[0] << " resume [snapshot] [Max no. of events] [--key=value ...]" << endl;
+			exit(0);
+		}
+		SnapshotReader snapshot;
+		if (!snapshot.open(argv[2])) {
+			cout << snapshot.error() << endl;
+			exit(1);
+		}
+		Network network(snapshot, options);
+		if (!snapshot.ok()) {
+			cout << "can not restore " << argv[2] << ": " << snapshot.error() << endl;
+			exit(1);
+		}
+		if (options.logLevel >= TRACE_SUMMARY) {
+			network.print();
+		}
+		network.simulate(stoi(argv[3]));
+		if (!options.savePath.empty() && !network.save(options.savePath)) {
+			cout << "can not write " << options.savePath << endl;
+		}
+		if (!options.exportFile.empty() && !network.export_tree(options.exportFile)) {
+			cout << "can not write " << options.exportFile << endl;
+		}
+		return 0;
+	}
+
+	Options options;
+	if (argc < 4 || !parse_options(argc, argv, 4, options)) {
+		cout << "Usage: " << argv[0] << " [no. of nodes] [z] [Max no. of events] [--key=value ...]" << endl;
 		exit(0);
 	}
 
     int n = stoi(argv[1]);
     double z = stod(argv[2]);
     int maxEvents = stoi(argv[3]);
-    Network network(n,z);
-    network.print();
+    Network network(n,z,options);
+    if (options.logLevel >= TRACE_SUMMARY) {
+        network.print();
+    }
     network.simulate(maxEvents);
-    network.visualize_blockchains();
+    if (!options.savePath.empty() && !network.save(options.savePath)) {
+        cout << "can not write " << options.savePath << endl;
+    }
+    if (!options.exportFile.empty() && !network.export_tree(options.exportFile)) {
+        cout << "can not write " << options.exportFile << endl;
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <stdint.h>
+#include "types.h"
+#include "transaction.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// which transactions go into a block when the mempool holds more than fit
+const int SELECT_OLDEST = 0; // first heard first
+const int SELECT_LARGEST = 1; // largest amount first
+
+// returns -1 if name is not a known policy
+inline int block_policy(const string &name) {
+	if (name == "oldest") {
+		return SELECT_OLDEST;
+	} else if (name == "largest") {
+		return SELECT_LARGEST;
+	}
+	return -1;
+}
+
+// unspent transactions heard by a node. a dense array of transactions plus an
+// id -> slot index, so insert and remove are O(1). removal moves the last
+// transaction into the freed slot.
+class Mempool {
+public:
+	Mempool() : _arrivals(0) {}
+
+	size_t size() const { return _txns.size(); }
+
+	bool empty() const { return _txns.empty(); }
+
+	bool contains(Id txnId) const { return _slots.count(txnId); }
+
+	// returns false if the transaction is already in the pool
+	bool insert(const Transaction *txn) {
+		if (!_slots.insert(make_pair(txn->id(), (uint32_t) _txns.size())).second) {
+			return false;
+		}
+		_txns.push_back(txn);
+		_arrived.push_back(_arrivals++);
+		return true;
+	}
+
+	// returns false if the transaction is not in the pool
+	bool remove(Id txnId) {
+		unordered_map<Id,uint32_t>::iterator it = _slots.find(txnId);
+		if (it == _slots.end()) {
+			return false;
+		}
+		uint32_t slot = it->second;
+		_slots.erase(it);
+		if (slot + 1 != _txns.size()) {
+			_txns[slot] = _txns.back();
+			_arrived[slot] = _arrived.back();
+			_slots[_txns[slot]->id()] = slot;
+		}
+		_txns.pop_back();
+		_arrived.pop_back();
+		return true;
+	}
+
+	// removes every transaction of a block, O(block size)
+	void remove_all(const vector<const Transaction*> &txns) {
+		for (const Transaction *txn : txns) {
+			remove(txn->id());
+		}
+	}
+
+	// fills block with at most maxTxns transactions (0 for no limit) picked by
+	// policy. the pool is left unchanged. with no limit, or when everything
+	// fits, the pool order is kept.
+	void select(size_t maxTxns, int policy, vector<const Transaction*> &block) {
+		block.clear();
+		if (maxTxns == 0 || maxTxns >= _txns.size()) {
+			block.assign(_txns.begin(), _txns.end());
+			return;
+		}
+		_order.resize(_txns.size());
+		for (uint32_t i = 0; i < _order.size(); i++) {
+			_order[i] = i;
+		}
+		if (policy == SELECT_LARGEST) {
+			nth_element(_order.begin(), _order.begin() + maxTxns, _order.end(), [this](uint32_t a, uint32_t b) {
+				if (_txns[a]->amount() != _txns[b]->amount()) {
+					return _txns[a]->amount() > _txns[b]->amount();
+				}
+				return _arrived[a] < _arrived[b];
+			});
+		} else {
+			nth_element(_order.begin(), _order.begin() + maxTxns, _order.end(), [this](uint32_t a, uint32_t b) {
+				return _arrived[a] < _arrived[b];
+			});
+		}
+		// keep the chosen ones in pool order so the result does not depend on nth_element
+		sort(_order.begin(), _order.begin() + maxTxns);
+		for (size_t i = 0; i < maxTxns; i++) {
+			block.push_back(_txns[_order[i]]);
+		}
+	}
+
+	void save(SnapshotWriter &out) const {
+		out.put_txns(_txns);
+		out.put_vector(_arrived);
+		out.put(_arrivals);
+	}
+
+	void load(SnapshotReader &in) {
+		in.get_txns(_txns);
+		in.get_vector(_arrived);
+		_arrivals = in.get<uint64_t>();
+		if (_arrived.size() != _txns.size()) {
+			in.fail("bad mempool");
+			_arrived.assign(_txns.size(), 0);
+		}
+		_slots.clear();
+		for (uint32_t i = 0; i < _txns.size(); i++) {
+			_slots[_txns[i]->id()] = i;
+		}
+	}
+
+private:
+	vector<const Transaction*> _txns; // dense, in slot order
+	vector<uint64_t> _arrived; // arrival number of each slot
+	unordered_map<Id,uint32_t> _slots; // transaction id -> slot
+	uint64_t _arrivals; // transactions inserted so far
+	vector<uint32_t> _order; // scratch space of select
+};
+
+#endif // MEMPOOL_H
@@ -0,0 +1,172 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <stdint.h>
+#include "types.h"
+#include "blocknode.h"
+
+using namespace std;
+
+// log-linear histogram in the style of HdrHistogram. values are counted in
+// whole units, below 128 units exactly and above that in buckets of 64 per
+// power of two, so a recorded value is known within 1/64 of itself. record
+// is a shift, a count leading zeros and an increment.
+class Histogram {
+public:
+	static const int SUB_BITS = 6;
+	static const uint64_t SUB = 1 << SUB_BITS; // buckets per power of two
+	static const size_t BUCKETS = (64 - SUB_BITS) * SUB + SUB;
+
+	Histogram(double unit = 1) : _unit(unit), _counts(BUCKETS, 0), _count(0), _sum(0),
+		_min(numeric_limits<double>::infinity()), _max(0) {}
+
+	void record(double value) {
+		value = value > 0 ? value : 0;
+		_counts[bucket((uint64_t) (value / _unit))]++;
+		_count++;
+		_sum += value;
+		_min = value < _min ? value : _min;
+		_max = value > _max ? value : _max;
+	}
+
+	void merge(const Histogram &other) {
+		for (size_t i = 0; i < BUCKETS; i++) {
+			_counts[i] += other._counts[i];
+		}
+		_count += other._count;
+		_sum += other._sum;
+		_min = other._min < _min ? other._min : _min;
+		_max = other._max > _max ? other._max : _max;
+	}
+
+	unsigned long long count() const { return _count; }
+
+	double mean() const { return _count > 0 ? _sum / _count : 0; }
+
+	// smallest bucket value with at least fraction of the values at or below it
+	double percentile(double fraction) const {
+		if (_count == 0) {
+			return 0;
+		}
+		unsigned long long rank = (unsigned long long) (fraction * _count + 0.5);
+		rank = rank < 1 ? 1 : rank;
+		unsigned long long seen = 0;
+		for (size_t i = 0; i < BUCKETS; i++) {
+			seen += _counts[i];
+			if (seen >= rank) {
+				double value = highest(i) * _unit;
+				return value < _max ? value : _max;
+			}
+		}
+		return _max;
+	}
+
+	// count, mean, extremes, percentiles and the non-empty buckets as
+	// [upper bound, count] pairs
+	void write_json(ostream &out) const {
+		out << "{\"count\": " << _count << ", \"mean\": " << mean()
+		    << ", \"min\": " << (_count > 0 ? _min : 0) << ", \"max\": " << _max
+		    << ", \"p50\": " << percentile(0.5) << ", \"p90\": " << percentile(0.9)
+		    << ", \"p99\": " << percentile(0.99) << ", \"p999\": " << percentile(0.999) << ", \"buckets\": [";
+		bool first = true;
+		for (size_t i = 0; i < BUCKETS; i++) {
+			if (_counts[i] > 0) {
+				out << (first ? "" : ", ") << "[" << highest(i) * _unit << ", " << _counts[i] << "]";
+				first = false;
+			}
+		}
+		out << "]}";
+	}
+
+private:
+	double _unit;
+	vector<unsigned long long> _counts;
+	unsigned long long _count;
+	double _sum;
+	double _min;
+	double _max;
+
+	static size_t bucket(uint64_t v) {
+		if (v < 2 * SUB) {
+			return v;
+		}
+		int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+		return shift * SUB + (v >> shift);
+	}
+
+	// largest whole unit value counted in bucket i
+	static uint64_t highest(size_t i) {
+		if (i < 2 * SUB) {
+			return i;
+		}
+		int shift = i / SUB - 1;
+		return ((i % SUB + SUB + 1) << shift) - 1;
+	}
+};
+
+// a node accepted a block, used for the propagation of blocks
+struct BlockReceipt {
+	Time time;
+	Id node;
+	const BlockNode *block;
+};
+
+inline bool earlier_receipt(const BlockReceipt &lhs, const BlockReceipt &rhs) {
+	return lhs.time < rhs.time || (lhs.time == rhs.time && lhs.node < rhs.node);
+}
+
+// measurements of a run updated as the events are simulated. each partition
+// keeps its own and they are merged at the end
+struct Metrics {
+	Histogram blockLatency; // block creation to its receipt, per receiving node
+	Histogram txnLatency; // transaction creation to its receipt, per receiving node
+	Histogram reach[3]; // block creation until 50%, 90% and all nodes had it
+	Histogram reorgDepth; // blocks undone by a switch to another branch
+	unsigned long long blockReceipts; // blocks accepted by a receiver
+	unsigned long long orphanReceipts; // of those, ones whose parent was missing
+	unsigned long long duplicateBlocks; // blocks a receiver already had
+	unsigned long long txnReceipts;
+	unsigned long long duplicateTxns;
+	vector<unsigned long long> mempool; // summed mempool size of the partition's nodes at each sample
+	vector<BlockReceipt> receipts; // parallel runs: blocks accepted during the current window
+
+	Metrics() : blockLatency(1e-6), txnLatency(1e-6), reorgDepth(1), blockReceipts(0), orphanReceipts(0),
+		duplicateBlocks(0), txnReceipts(0), duplicateTxns(0)
+	{
+		for (Histogram &h : reach) {
+			h = Histogram(1e-6);
+		}
+	}
+
+	void merge(const Metrics &other) {
+		blockLatency.merge(other.blockLatency);
+		txnLatency.merge(other.txnLatency);
+		for (int i = 0; i < 3; i++) {
+			reach[i].merge(other.reach[i]);
+		}
+		reorgDepth.merge(other.reorgDepth);
+		blockReceipts += other.blockReceipts;
+		orphanReceipts += other.orphanReceipts;
+		duplicateBlocks += other.duplicateBlocks;
+		txnReceipts += other.txnReceipts;
+		duplicateTxns += other.duplicateTxns;
+		// a partition without events near the end stopped sampling early, its state stayed the same
+		unsigned long long last = mempool.empty() ? 0 : mempool.back();
+		unsigned long long otherLast = other.mempool.empty() ? 0 : other.mempool.back();
+		size_t samples = max(mempool.size(), other.mempool.size());
+		for (size_t i = 0; i < samples; i++) {
+			unsigned long long value = i < other.mempool.size() ? other.mempool[i] : otherLast;
+			if (i < mempool.size()) {
+				mempool[i] += value;
+			} else {
+				mempool.push_back(last + value);
+			}
+		}
+	}
+};
+
+#endif // METRICS_H
@@ -5,23 +5,54 @@
 #include <vector>
 #include <queue>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <assert.h>
-#include <random>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <limits>
+#include <unordered_map>
 #include "node.h"
 #include "event.h"
+#include "scheduler.h"
+#include "options.h"
+#include "trace.h"
+#include "links.h"
+#include "latency.h"
+#include "topology.h"
+#include "parallel.h"
+#include "rng.h"
+#include "store.h"
 #include "visualize.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "profile.h"
 
 using namespace std;
 
+// message sizes in Mb, sent over links of 5 or 100 Mbps
+const int TXN_SIZE = 0;
+const int BLOCK_SIZE = 100;
+const int COMPACT_BLOCK_SIZE = 1; // header and transaction ids
+const int REQUEST_SIZE = 0; // request for the transactions missing from a compact block
+
 class Network {
 public:
-    Network(int n, double z) : _propDelays(n, vector<double>(n)),
-                               _queuingDelays(n, vector<double>(n)),
-                               _bottleneckSpeeds(n, vector<double>(n)),
-                               _generator(time(NULL))
+    Network(int n, double z, const Options &options = Options()) : _store(max(1, min(options.threads, n))),
+                               _tracer(options.logLevel),
+                               _resolution(latency_resolution(options.latency)),
+                               _until(options.until),
+                               _stream(stream_key(options.seed, NETWORK_STREAM, 0)),
+                               _batchRelay(options.relay == "batch"),
+                               _relayInterval(options.relayInterval),
+                               _relayBatch(options.relayBatch),
+                               _compactBlocks(options.blockRelay == "compact"),
+                               _lazyDelivery(options.delivery == "lazy"),
+                               _txnRate(options.txnRate),
+                               _blockRate(options.blockRate),
+                               _started(false)
     {
-        srand(time(NULL));
         // create n nodes of which z% are slow and rest are fast
         int t = floor(n*z);
         NodeType type;
@@ -29,70 +60,364 @@ public:
         double txnCreationRate, blockCreationRate;  // lambda values for interarrival exponential distribution
         for (int id = 0; id < n; id++) {
             type = (id < t) ? SLOW : FAST;
-            blockCreationRate = (500 + (rand() % 1500)) / 4000.0;
-            txnCreationRate = (500 + (rand() % 1500)) / 1000.0;
-            _nodes.push_back(new Node(id,type,txnCreationRate,blockCreationRate));
+            blockCreationRate = options.blockRate * (500 + _stream.below(1500)) / 4000.0;
+            txnCreationRate = options.txnRate * (500 + _stream.below(1500)) / 1000.0;
+            _nodeTable.add(type, txnCreationRate, blockCreationRate, stream_key(options.seed, NODE_STREAM, id));
+            SeenFilter *heardTxns = make_seen_filter(options.seen, options.seenCapacity, options.seenFpRate,
+                                                     stream_key(options.seed, FILTER_STREAM, id));
+            assert(heardTxns != NULL);
+            _nodes.push_back(new Node(id,_nodeTable,n,_store.genesis(),options.blockSize,options.blockPolicy,heardTxns));
+            _nodes.back()->blockChain().limit_orphans(options.orphanLimit, options.orphanTtl);
         }
 
-        // add random number of peers to each node
-        for (int i = 0; i < n; i++) {
-            for (int j = i+1; j < n; j++) {
-                if (rand() % 2) {
-                    _nodes[i]->add_neighbor(j);
-                    _nodes[j]->add_neighbor(i);
-                }
-            }
+        // connect the peers with the selected topology
+        vector<Link> links;
+        TopologyGenerator *topology = make_topology(options.topology, options.degree, options.rewire);
+        assert(topology != NULL);
+        topology->generate(n, stream_key(options.seed, TOPOLOGY_STREAM, 0), links);
+        delete topology;
+        vector<int> degrees(n, 0);
+        for (const Link &link : links) {
+            degrees[link.a]++;
+            degrees[link.b]++;
+        }
+        for (int i = 0; n > 1 && i < n; i++) {
             // if node has no peer, add a random peer
-            if(_nodes[i]->nbrs().size() == 0) {
+            if (degrees[i] == 0) {
                 int j;
-                while ((j = rand() % n) == i);
-                _nodes[i]->add_neighbor(j);
-                _nodes[j]->add_neighbor(i);
+                while ((j = _stream.below(n)) == i);
+                add_link(links, degrees, i, j);
             }
         }
 
-        initialize_parameters();
+        initialize_parameters(links);
+        _links.build(n, links);
+        _latency.build(_links, options.seed, _resolution);
+
+        // every message spends at least the smallest propagation delay on its link
+        _lookahead = _latency.min_latency();
+
+        _pushCounts.assign(n, 0);
+        _relayBuffers.resize(_links.edges());
+        _flushPending.assign(n, 0);
+        start_run(options);
+    }
+
+    // continues the network saved in a snapshot, in must have been opened
+    // successfully. the options give the settings of the continued run, which
+    // may differ from the saved one: node rates are scaled by the ratio of
+    // --txn-rate and --block-rate to the saved values. the topology and seed
+    // options are not used. check in.ok() before simulating.
+    Network(SnapshotReader &in, const Options &options) : _store(max((size_t) 1, min((size_t) options.threads, in.nodes()))),
+                               _tracer(options.logLevel),
+                               _resolution(latency_resolution(options.latency)),
+                               _until(options.until),
+                               _batchRelay(options.relay == "batch"),
+                               _relayInterval(options.relayInterval),
+                               _relayBatch(options.relayBatch),
+                               _compactBlocks(options.blockRelay == "compact"),
+                               _lazyDelivery(options.delivery == "lazy"),
+                               _txnRate(options.txnRate),
+                               _blockRate(options.blockRate),
+                               _started(true)
+    {
+        in.attach(_store);
+        restore(in, options);
+    }
+
+    ~Network() {
+        // inventory batches are freed by their receiver, those still queued here
+        vector<Event> events;
+        vector<uint64_t> keys;
+        for (Partition *partition : _partitions) {
+            partition->queue->pending_events(events, keys);
+            for (const vector<Message> &outbox : partition->outbox) {
+                for (const Message &message : outbox) {
+                    events.push_back(message.event);
+                }
+            }
+        }
+        for (const Event &event : events) {
+            if (event.type == RECEIVE_INVENTORY) {
+                delete event.txns;
+            }
+        }
+        for (Partition *partition : _partitions) {
+            delete partition;
+        }
     }
 
     void simulate(int maxEvents=100) {
-        initialize_events();
-        cout << "max events = " << maxEvents << endl;
-        int eventCounter = 0;
-        int ctc = 0; // number of create transaction events
-        int cbc = 0; // number of create block events
-        int rtc = 0; // number of receive transaction events
-        int rbc = 0; // number of receive block events
-        while (!_eventsQueue.empty() && eventCounter < maxEvents) {
-            Event *event = _eventsQueue.top();
-            _eventsQueue.pop();
-            eventCounter++;
-            cout << "------------------ Event " << eventCounter << " at " << event->occurenceTime() << " ----------------------" << endl;
-            switch(event->type()) {
-                case CREATE_TRANSACTION:
-                    create_transaction(event);
-                    ctc++;
-                    break;
-                case CREATE_BLOCK:
-                    create_block(event);
-                    cbc++;
-                    break;
-                case RECEIVE_TRANSACTION:
-                    receive_transaction(event);
-                    rtc++;
-                    break;
-                case RECEIVE_BLOCK:
-                    receive_block(event);
-                    rbc++;
-                    break;
-                default:
-                    assert(false); // should not come here
-            }
-            cout << endl;
-        }
-        cout << "ctc = " << ctc << endl;
-        cout << "cbc = " << cbc << endl;
-        cout << "rtc = " << rtc << endl;
-        cout << "rbc = " << rbc << endl;
+        if (!_started) {
+            initialize_events();
+        }
+        if (_tracer.enabled(TRACE_SUMMARY)) {
+            cout << "max events = " << maxEvents << endl;
+        }
+        if (_measuring) {
+            start_metrics();
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        PROFILE(start_progress(start);)
+        if (_partitions.size() == 1) {
+            run_sequential(maxEvents);
+        } else {
+            run_parallel(maxEvents);
+        }
+        _tracer.flush();
+        _stats = RunStats();
+        _stats.elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        for (Partition *partition : _partitions) {
+            const RunStats &stats = partition->stats;
+            _stats.events += stats.events;
+            _stats.ctc += stats.ctc;
+            _stats.cbc += stats.cbc;
+            _stats.rtc += stats.rtc;
+            _stats.rbc += stats.rbc;
+            _stats.flushes += stats.flushes;
+            _stats.inventories += stats.inventories;
+            _stats.inventoryTxns += stats.inventoryTxns;
+            _stats.compactBlocks += stats.compactBlocks;
+            _stats.compactMisses += stats.compactMisses;
+            _stats.messages += stats.messages;
+            _stats.windows = max(_stats.windows, stats.windows);
+            _stats.lastTime = max(_stats.lastTime, stats.lastTime);
+            _stats.staleAvoided += partition->queue->stale_avoided();
+            _stats.stalePopped += partition->queue->stale_popped();
+        }
+        for (Node *node : _nodes) {
+            _stats.orphansExpired += node->blockChain().orphans_expired();
+            _stats.reorgs += node->ledger().reorgs();
+            _stats.undone += node->ledger().undone();
+        }
+        if (_measuring) {
+            _metrics = Metrics();
+            for (Partition *partition : _partitions) {
+                sample_mempools(*partition, _stats.lastTime);
+                _metrics.merge(partition->metrics);
+            }
+            if (!write_metrics(_metricsFile)) {
+                cout << "can not write " << _metricsFile << endl;
+            }
+        }
+        PROFILE(
+            if (!_profileFile.empty() && !write_profile(_profileFile)) {
+                cout << "can not write " << _profileFile << endl;
+            }
+        )
+        if (!_tracer.enabled(TRACE_SUMMARY)) {
+            return;
+        }
+        cout << "ctc = " << _stats.ctc << endl;
+        cout << "cbc = " << _stats.cbc << endl;
+        cout << "rtc = " << _stats.rtc << endl;
+        cout << "rbc = " << _stats.rbc << endl;
+        cout << "stale events avoided = " << _stats.staleAvoided << ", stale events popped = " << _stats.stalePopped << endl;
+        if (_batchRelay) {
+            cout << "relay flushes = " << _stats.flushes << ", inventories = " << _stats.inventories
+                 << ", transactions per inventory = " << (_stats.inventories > 0 ? (double) _stats.inventoryTxns / _stats.inventories : 0) << endl;
+        }
+        if (_compactBlocks) {
+            cout << "compact blocks = " << _stats.compactBlocks << ", with missing transactions = " << _stats.compactMisses << endl;
+        }
+        cout << "events per simulated second = " << (_stats.lastTime > 0 ? _stats.events / _stats.lastTime : 0) << endl;
+        cout << "nodes on the main chain = " << nodes_on_branch(best_top()).size() << " of " << _nodes.size() << endl;
+        cout << "reorgs = " << _stats.reorgs << ", blocks undone = " << _stats.undone << endl;
+        if (_stats.orphansExpired > 0) {
+            cout << "orphans expired = " << _stats.orphansExpired << endl;
+        }
+        if (_finality > 0) {
+            cout << "prunes = " << _pruned.prunes << ", root height = " << _store.genesis()->height()
+                 << ", blocks freed = " << _pruned.blocks << ", transactions freed = " << _pruned.txns
+                 << ", bytes freed = " << _pruned.bytes << ", live blocks = " << _store.live_blocks()
+                 << ", live transactions = " << _store.live_txns() << endl;
+        }
+        if (_partitions.size() > 1) {
+            cout << "partitions = " << _partitions.size() << ", windows = " << _stats.windows
+                 << ", cross partition events = " << _stats.messages << endl;
+        }
+        cout << "seen filter = " << _nodes[0]->heard_txns().name() << ", bytes per node = " << seen_filter_bytes() << endl;
+        cout << "state digest = " << hex << digest() << dec << endl;
+        cout << "scheduler = " << _partitions[0]->queue->name() << ", events/sec = "
+             << (_stats.elapsed > 0 ? _stats.events / _stats.elapsed : 0) << endl;
+    }
+
+    // totals of the last simulate call
+    const RunStats& stats() const { return _stats; }
+
+    // peers of every node
+    const LinkTable& links() const { return _links; }
+
+    // entries in the event queues, with lazy delivery a broadcast is one
+    size_t queued() const {
+        size_t entries = 0;
+        for (Partition *partition : _partitions) {
+            entries += partition->queue->size();
+        }
+        return entries;
+    }
+
+    // latency of a message of size_m sent over edge, drawn from the edge's stream
+    Time get_latency(size_t edge, int size_m) { return _latency.sample(edge, size_m); }
+
+    // latencies of a message of size_m from node to each of its peers but
+    // skipPeer, indexed by edge - links().begin(node)
+    void get_latencies(Id node, Id skipPeer, int size_m, vector<Time> &latencies) {
+        _latency.sample_range(_links.begin(node), _links.end(node), edge_to(node, skipPeer), size_m, latencies);
+    }
+
+    // measurements of the last simulate call, if --metrics is given
+    const Metrics& metrics() const { return _metrics; }
+
+    // writes the metrics and the block tree measures as one JSON object
+    bool write_metrics(const string &path) {
+        ofstream out(path.c_str());
+        if (!out.is_open()) {
+            return false;
+        }
+        out.precision(9);
+        ChainMetrics chain = chain_metrics();
+        out << "{\n";
+        out << "  \"nodes\": " << _nodes.size() << ",\n";
+        out << "  \"events\": " << _stats.events << ",\n";
+        out << "  \"simulated_time\": " << _stats.lastTime << ",\n";
+        out << "  \"blocks\": {\"created\": " << chain.blocks << ", \"main_chain\": " << chain.mainLength
+            << ", \"forks\": " << chain.forks << ", \"stale_rate\": " << chain.staleRatio
+            << ", \"receipts\": " << _metrics.blockReceipts << ", \"orphan_rate\": "
+            << (_metrics.blockReceipts > 0 ? (double) _metrics.orphanReceipts / _metrics.blockReceipts : 0)
+            << ", \"duplicates\": " << _metrics.duplicateBlocks << "},\n";
+        out << "  \"transactions\": {\"receipts\": " << _metrics.txnReceipts
+            << ", \"duplicates\": " << _metrics.duplicateTxns << "},\n";
+        const char *reach[] = {"reach_50", "reach_90", "reach_100"};
+        for (int f = 0; f < 3; f++) {
+            out << "  \"" << reach[f] << "\": ";
+            _metrics.reach[f].write_json(out);
+            out << ",\n";
+        }
+        out << "  \"block_latency\": ";
+        _metrics.blockLatency.write_json(out);
+        out << ",\n  \"txn_latency\": ";
+        _metrics.txnLatency.write_json(out);
+        out << ",\n  \"reorg_depth\": ";
+        _metrics.reorgDepth.write_json(out);
+
+        // share of each node's blocks that ended up on the main chain
+        vector<unsigned long long> onMain(_pruned.mainByCreator);
+        for (BlockNode *block = best_top(); block != NULL && block->id() != GENESIS_ID; block = block->parentNode()) {
+            onMain[(block->id() - GENESIS_ID - 1) % _nodes.size()]++;
+        }
+        out << ",\n  \"main_chain_share\": [";
+        for (size_t id = 0; id < _nodes.size(); id++) {
+            unsigned long long created = _nodes[id]->blocks_created();
+            out << (id > 0 ? ", " : "") << (created > 0 ? (double) onMain[id] / created : 0);
+        }
+        out << "],\n  \"pruning\": {\"prunes\": " << _pruned.prunes << ", \"root_height\": " << _store.genesis()->height()
+            << ", \"blocks\": " << _pruned.blocks << ", \"main_chain_blocks\": " << _pruned.mainBlocks
+            << ", \"transactions\": " << _pruned.txns << ", \"bytes\": " << _pruned.bytes
+            << ", \"live_blocks\": " << _store.live_blocks() << ", \"live_transactions\": " << _store.live_txns() << "}";
+        out << ",\n  \"seen_filter\": {\"kind\": \"" << _nodes[0]->heard_txns().name() << "\", \"bytes_per_node\": "
+            << seen_filter_bytes() << "}";
+        out << ",\n  \"mempool\": {\"start\": " << _sampleStart << ", \"interval\": " << _sampleInterval << ", \"total\": [";
+        for (size_t i = 0; i < _metrics.mempool.size(); i++) {
+            out << (i > 0 ? ", " : "") << _metrics.mempool[i];
+        }
+        out << "]}\n}\n";
+        return out.good();
+    }
+
+    // shape of the shared block tree, pruned blocks included. the main chain
+    // ends at the highest top of any node
+    ChainMetrics chain_metrics() {
+        ChainMetrics metrics;
+        unordered_map<Id,int> children;
+        _store.for_each_block([&metrics, &children](BlockNode *block) {
+            if (block->id() != GENESIS_ID) {
+                metrics.blocks++;
+            }
+            if (block->parentNode() != NULL) {
+                children[block->parentNode()->id()]++;
+            }
+        });
+        metrics.blocks += _pruned.blocks;
+        metrics.forks += _pruned.forks;
+        metrics.mainLength = best_top()->height() - 1;
+        for (auto &c : children) {
+            if (c.second > 1) {
+                metrics.forks++;
+            }
+        }
+        if (metrics.blocks > 0) {
+            metrics.staleRatio = (double) (metrics.blocks - metrics.mainLength) / metrics.blocks;
+        }
+        if (metrics.mainLength > 0) {
+            metrics.forkRate = (double) metrics.forks / metrics.mainLength;
+        }
+        if (_stats.lastTime > 0) {
+            metrics.growthRate = metrics.mainLength / _stats.lastTime;
+        }
+        return metrics;
+    }
+
+    // highest top of any node, the lowest id among equally high ones
+    BlockNode* best_top() {
+        BlockNode *best = _nodeTable.top(0);
+        for (Id id = 0; id < _nodeTable.nodes(); id++) {
+            BlockNode *top = _nodeTable.top(id);
+            if (top->height() > best->height() ||
+                (top->height() == best->height() && top->id() < best->id())) {
+                best = top;
+            }
+        }
+        return best;
+    }
+
+    // mean memory of the nodes' filters of heard transactions
+    double seen_filter_bytes() const {
+        double bytes = 0;
+        for (Node *node : _nodes) {
+            bytes += node->heard_txns().bytes();
+        }
+        return bytes / _nodes.size();
+    }
+
+    // nodes whose main chain contains block, O(n log height) on the shared tree
+    vector<Id> nodes_on_branch(BlockNode *block) {
+        vector<Id> nodes;
+        for (Id id = 0; id < _nodeTable.nodes(); id++) {
+            BlockNode *top = _nodeTable.top(id);
+            if (top->height() >= block->height() && top->ancestor(block->height()) == block) {
+                nodes.push_back(id);
+            }
+        }
+        return nodes;
+    }
+
+    // nodes which have connected block
+    vector<Id> nodes_with_block(const BlockNode *block) {
+        vector<Id> nodes;
+        for (Node *node : _nodes) {
+            if (node->blockChain().contains(block)) {
+                nodes.push_back(node->id());
+            }
+        }
+        return nodes;
+    }
+
+    // hash over the final state of every node, equal for runs which simulated
+    // the same events in the same per node order
+    unsigned long long digest() {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (Id id = 0; id < _nodeTable.nodes(); id++) {
+            BlockNode *top = _nodeTable.top(id);
+            Coin money = _nodeTable.balance(id);
+            uint64_t bits; // the balance's bytes, copied to stay clear of strict aliasing
+            memcpy(&bits, &money, sizeof bits);
+            unsigned long long words[] = {top->block().id(), top->height(), _nodes[id]->unspent_txns(), bits};
+            for (unsigned long long word : words) {
+                hash = (hash ^ word) * 1099511628211ULL;
+            }
+        }
+        return hash;
     }
 
     void print() {
@@ -100,148 +425,1154 @@ public:
         for (Node *node : _nodes) {
             cout << (node->type() == SLOW ? "Slow " : "Fast ");
             cout << node->id() << ": ";
-            for (Id nbr : node->nbrs()) {
-                cout << nbr << " ";
+            for (size_t e = _links.begin(node->id()); e < _links.end(node->id()); e++) {
+                cout << _links.neighbor(e) << " ";
             }
             cout << "| (" << node->txnCreationTime() << "," << node->blockCreationTime() << ")" << endl;
         }
         cout << endl;
     }
 
-    void visualize_blockchains() {
+    // writes the block tree with every node's view of it to path, as dot,
+    // json or csv by the extension. returns false if it can not be written
+    bool export_tree(const string &path) {
+        unsigned threads = thread::hardware_concurrency();
+        TreeExporter exporter(_store, _nodes, best_top(), export_format(path));
+        return exporter.write(path, threads > 0 ? threads : 1);
+    }
+
+    // writes the state of every node, link, object and pending event to
+    // path, so that a network restored from it continues exactly like this
+    // one would. not to be called while simulate runs.
+    // returns false if the file can not be written
+    bool save(const string &path) {
+        if (!_started) {
+            initialize_events();
+        }
+        SnapshotWriter out;
+        if (!out.open(path, _nodes.size())) {
+            return false;
+        }
+        out.put(_txnRate);
+        out.put(_blockRate);
+        _links.save(out);
+        out.put_vector(_latency.keys());
+        out.put_vector(_latency.counters());
+        out.put_vector(_pushCounts);
+        unsigned long long pruned[] = {_pruned.prunes, _pruned.blocks, _pruned.mainBlocks, _pruned.forks,
+                                       _pruned.txns, _pruned.bytes};
+        for (unsigned long long count : pruned) {
+            out.put(count);
+        }
+        out.put_vector(_pruned.mainByCreator);
+        out.put_txns(_unfreedTxns);
+
+        // blocks by index, so a parent always comes before its children. the
+        // root and detached blocks may have none, they keep their height
+        out.put((uint64_t) _store.blocks());
+        _store.for_each_block([&out](BlockNode *block) {
+            out.put(block->id());
+            out.put(block->block().parentId());
+            out.put(block->block().created());
+            out.put((uint8_t) (block->parentNode() != NULL));
+            if (block->parentNode() != NULL) {
+                out.put_block(block->parentNode());
+            } else {
+                out.put((uint64_t) block->height());
+            }
+            out.put((uint8_t) block->detached());
+            out.put_txns(block->block().transactions());
+            out.put((uint8_t) block->validated());
+            out.put_vector(block->rejected());
+        });
         for (Node *node : _nodes) {
-            visualize_blockchain(node);
+            node->save(out);
+        }
+        for (const vector<const Transaction*> &buffer : _relayBuffers) {
+            out.put_txns(buffer);
+        }
+        out.put_vector(_flushPending);
+
+        vector<Event> events;
+        vector<uint64_t> eventKeys;
+        for (Partition *partition : _partitions) {
+            partition->queue->pending_events(events, eventKeys);
         }
+        // a broadcast is saved as the separate events it stands for
+        for (size_t i = 0, count = events.size(); i < count; i++) {
+            if (events[i].type != FANOUT) {
+                continue;
+            }
+            const Fanout &fanout = *events[i].fanout;
+            for (size_t d = fanout.next; d < fanout.deliveries.size(); d++) {
+                Event received = fanout.event;
+                received.time = fanout.deliveries[d].time;
+                received.node = fanout.deliveries[d].node;
+                events.push_back(received);
+                eventKeys.push_back(fanout.deliveries[d].key);
+            }
+        }
+        uint64_t saved = 0;
+        for (const Event &event : events) {
+            saved += event.type != FANOUT;
+        }
+        out.put(saved);
+        for (size_t i = 0; i < events.size(); i++) {
+            if (events[i].type != FANOUT) {
+                save_event(out, events[i], eventKeys[i]);
+            }
+        }
+        return out.close();
     }
 
 private:
-    vector<Node*> _nodes;
-    vector<vector<double>> _propDelays;
-    vector<vector<double>> _queuingDelays;
-    vector<vector<double>> _bottleneckSpeeds;
-    priority_queue<Event*, vector<Event*>, EventComparison> _eventsQueue;
-    std::default_random_engine _generator;
-
-    void initialize_parameters() {
-        int n = _nodes.size();
-        std::uniform_int_distribution<int> uniformDistribution(10,500);
-        for (int i = 0; i < n; i++) {
-            Node *ni = _nodes[i];
-            for (int j = i+1; j < n; j++) {
-                Node *nj = _nodes[j];
-                // if both nodes are fast, link speed is 100 Mbps else it is 5 Mbps
-                if (ni->type() == FAST && nj->type() == FAST) {
-                    _bottleneckSpeeds[i][j] = _bottleneckSpeeds[j][i] = 100;
+    ObjectStore _store; // every transaction and block, one shard per partition
+    NodeTable _nodeTable; // scalar state of every node, in arrays by id
+    vector<Node*> _nodes; // containers of every node, rows of _nodeTable
+    LinkTable _links; // peers of each node and the attributes of every link
+    vector<Partition*> _partitions; // nodes and pending events of each thread
+    vector<size_t> _owner; // partition of each node
+    vector<EventHandle> _miningEvents; // pending CREATE_BLOCK event of each node
+    vector<uint64_t> _pushCounts; // events scheduled by each node so far
+    Tracer _tracer;
+    bool _tracing; // per event records are enabled
+    double _resolution; // step latencies are rounded down to, 0 for none
+    Time _lookahead; // lower bound on the latency of any message
+    Time _until; // simulated time at which the run stops
+    RunStats _stats;
+    Stream _stream; // network setup draws
+    bool _batchRelay; // buffer transactions per link instead of flooding them one by one
+    Time _relayInterval;
+    size_t _relayBatch;
+    bool _compactBlocks; // announce blocks as transaction id lists
+    bool _lazyDelivery; // queue one FANOUT event per broadcast instead of one event per receiver
+    double _txnRate; // --txn-rate the node rates were scaled by
+    double _blockRate; // --block-rate the node rates were scaled by
+    bool _started; // the initial events have been queued
+    bool _measuring; // update the metrics during the run
+    string _metricsFile;
+    Time _sampleInterval; // simulated seconds between mempool samples
+    Time _sampleStart; // time of the first mempool sample
+    size_t _reachCounts[3]; // nodes that make up 50%, 90% and all of the network
+    vector<uint32_t> _reached; // by tree node index, nodes which have accepted the block
+    Metrics _metrics; // merged over partitions at the end of a run
+    vector<vector<const Transaction*> > _relayBuffers; // batch relay: transactions waiting on each directed edge
+    vector<uint8_t> _flushPending; // batch relay: the node has a RELAY_FLUSH event queued. a byte each, partitions never share a word
+    LatencyModel _latency; // latency draws of each directed edge
+    unsigned long _finality; // depth below every top at which blocks are pruned, 0 for never
+    Time _pruneInterval; // simulated seconds between prunings
+    Time _nextPrune; // simulated time of the next pruning
+    PruneSummary _pruned; // freed by the prunings so far
+    vector<const Transaction*> _unfreedTxns; // confirmed by freed blocks, but still carried by an event
+#ifdef P2P_PROFILE
+    string _profileFile;
+    double _progressInterval; // wall clock seconds between progress lines, 0 for none
+    chrono::steady_clock::time_point _lastProgress;
+    unsigned long long _progressEvents; // partition 0 events at the last progress line
+    Time _progressTime; // simulated time at the last progress line
+#endif
+
+    // opens the trace and splits the nodes into contiguous ranges, one per thread
+    void start_run(const Options &options) {
+        if (!options.traceFile.empty() && !_tracer.open(options.traceFile, options.traceColumns)) {
+            cout << "can not open " << options.traceFile << endl;
+        }
+        if (options.traceAsync) {
+            _tracer.start_writer();
+        }
+        _tracing = _tracer.enabled(TRACE_EVENTS);
+        size_t n = _nodes.size();
+        size_t partitions = max((size_t) 1, min((size_t) options.threads, n));
+        for (size_t p = 0; p < partitions; p++) {
+            _partitions.push_back(new Partition(p, partitions, make_event_queue(options.queue)));
+        }
+        for (size_t id = 0; id < n; id++) {
+            _owner.push_back(id * partitions / n);
+        }
+        _finality = options.finality;
+        _pruneInterval = options.pruneInterval;
+        _nextPrune = 0;
+        _pruned.mainByCreator.resize(n, 0);
+        _measuring = !options.metricsFile.empty();
+        _metricsFile = options.metricsFile;
+        _sampleInterval = options.metricsInterval;
+        _sampleStart = -1;
+        double fractions[] = {0.5, 0.9, 1};
+        for (int f = 0; f < 3; f++) {
+            _reachCounts[f] = max((size_t) 1, (size_t) ceil(fractions[f] * n));
+        }
+        PROFILE(
+            _profileFile = options.profileFile;
+            _progressInterval = options.progressInterval;
+            for (Partition *partition : _partitions) {
+                partition->profile.fanout.assign(n, 0);
+            }
+        )
+    }
+
+#ifdef P2P_PROFILE
+    void start_progress(chrono::steady_clock::time_point start) {
+        _lastProgress = start;
+        _progressEvents = _partitions[0]->stats.events;
+        _progressTime = _partitions[0]->stats.lastTime;
+        if (_progressTime == 0) {
+            _partitions[0]->queue->next_time(_progressTime);
+        }
+    }
+
+    // counts a dispatched event and samples the queue, begin is the cycle
+    // count before its handler ran
+    void profile_event(Partition &part, const Event &event, uint64_t begin) {
+        Profile &profile = part.profile;
+        profile.cycles[event.type] += cycle_count() - begin;
+        profile.events[event.type]++;
+        size_t pending = part.queue->size();
+        profile.queueSize.record(pending);
+        if (part.stats.events % PROFILE_SAMPLE_EVENTS == 0) {
+            profile.queueSamples.push_back(make_pair(event.time, pending));
+            if (part.index == 0 && _progressInterval > 0) {
+                progress(part, event.time);
+            }
+        }
+    }
+
+    // rates since the last progress line, partition 0 only in parallel runs
+    void progress(Partition &part, Time time) {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        double wall = chrono::duration<double>(now - _lastProgress).count();
+        if (wall < _progressInterval) {
+            return;
+        }
+        cerr << "progress: time = " << time << ", events = " << part.stats.events
+             << ", events/sec = " << (part.stats.events - _progressEvents) / wall
+             << ", simulated sec/sec = " << (time - _progressTime) / wall
+             << ", queue = " << part.queue->size() << (_partitions.size() > 1 ? " (partition 0)" : "") << endl;
+        _lastProgress = now;
+        _progressEvents = part.stats.events;
+        _progressTime = time;
+    }
+
+    // handler cycles per event type, queue sizes, allocated bytes and fan-out
+    // of the last simulate call as one JSON object
+    bool write_profile(const string &path) {
+        ofstream out(path.c_str());
+        if (!out.is_open()) {
+            return false;
+        }
+        out.precision(9);
+        Profile profile;
+        size_t pending = 0, capacity = 0;
+        for (Partition *partition : _partitions) {
+            profile.merge(partition->profile);
+            pending += partition->queue->size();
+            capacity += partition->queue->capacity();
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        out << "{\n  \"cycle_unit\": \"tsc\",\n";
+#else
+        out << "{\n  \"cycle_unit\": \"ns\",\n";
+#endif
+        out << "  \"events\": {";
+        unsigned long long cycles = profile.popCycles;
+        for (int t = 0; t < EVENT_TYPES; t++) {
+            cycles += profile.cycles[t];
+            out << (t > 0 ? ", " : "") << "\"" << EVENT_NAMES[t] << "\": {\"count\": " << profile.events[t]
+                << ", \"cycles\": " << profile.cycles[t] << ", \"cycles_per_event\": "
+                << (profile.events[t] > 0 ? (double) profile.cycles[t] / profile.events[t] : 0) << "}";
+        }
+        out << "},\n  \"pop_cycles\": " << profile.popCycles << ",\n";
+        out << "  \"total_cycles\": " << cycles << ",\n";
+        out << "  \"stale_popped\": " << _stats.stalePopped << ", \"stale_avoided\": " << _stats.staleAvoided << ",\n";
+        out << "  \"queue_size\": ";
+        profile.queueSize.write_json(out);
+        out << ",\n  \"queue_samples\": [";
+        for (size_t p = 0; p < _partitions.size(); p++) {
+            const vector<pair<Time,size_t> > &samples = _partitions[p]->profile.queueSamples;
+            out << (p > 0 ? ", " : "") << "[";
+            for (size_t i = 0; i < samples.size(); i++) {
+                out << (i > 0 ? ", " : "") << "[" << samples[i].first << ", " << samples[i].second << "]";
+            }
+            out << "]";
+        }
+        // every dispatched or pending event had a record of its own
+        out << "],\n  \"bytes\": {\"events\": " << (_stats.events + pending) * sizeof(Event)
+            << ", \"event_slab\": " << capacity * sizeof(Event) << ", \"transactions\": " << profile.txnBytes
+            << ", \"blocks\": " << profile.blockBytes << ", \"inventories\": " << profile.inventoryBytes << "},\n";
+        Histogram fanout;
+        for (unsigned long long count : profile.fanout) {
+            fanout.record(count);
+        }
+        out << "  \"fanout\": ";
+        fanout.write_json(out);
+        out << ",\n  \"fanout_by_node\": [";
+        for (size_t id = 0; id < profile.fanout.size(); id++) {
+            out << (id > 0 ? ", " : "") << profile.fanout[id];
+        }
+        out << "]\n}\n";
+        return out.good();
+    }
+#endif
+
+    // the first mempool sample follows the earliest pending event, blocks
+    // which some nodes have heard already continue from their count
+    void start_metrics() {
+        if (_sampleStart < 0) {
+            Time first = numeric_limits<double>::infinity();
+            Time time;
+            for (Partition *partition : _partitions) {
+                if (partition->queue->next_time(time)) {
+                    first = min(first, time);
+                }
+            }
+            _sampleStart = first < numeric_limits<double>::infinity() ? ceil(first / _sampleInterval) * _sampleInterval : 0;
+        }
+        _reached.assign(_store.blocks(), 0);
+        for (Node *node : _nodes) {
+            node->for_each_heard_block([this](uint32_t index) {
+                _reached[index]++;
+            });
+        }
+    }
+
+    // records the summed mempool size of the partition's nodes at every
+    // sample time before time
+    void sample_mempools(Partition &part, Time time) {
+        Metrics &metrics = part.metrics;
+        size_t n = _nodes.size(), partitions = _partitions.size();
+        while (_sampleStart + metrics.mempool.size() * _sampleInterval < time) {
+            unsigned long long total = 0;
+            for (size_t id = (part.index * n + partitions - 1) / partitions; id < n && _owner[id] == part.index; id++) {
+                total += _nodes[id]->unspent_txns();
+            }
+            metrics.mempool.push_back(total);
+        }
+    }
+
+    // a node accepted block at time. with several partitions the receipts
+    // of a window are counted at its end in time order, so the reach times
+    // are the same with any number of threads
+    void block_accepted(Partition &part, const BlockNode *block, Id nodeId, Time time) {
+        BlockReceipt receipt = {time, nodeId, block};
+        if (_partitions.size() == 1) {
+            count_reach(part.metrics, receipt);
+        } else {
+            part.metrics.receipts.push_back(receipt);
+        }
+    }
+
+    void count_reach(Metrics &metrics, const BlockReceipt &receipt) {
+        uint32_t i = receipt.block->index();
+        if (i >= _reached.size()) {
+            _reached.resize(i + 1, 0);
+        }
+        uint32_t reached = ++_reached[i];
+        for (int f = 0; f < 3; f++) {
+            if (reached == _reachCounts[f]) {
+                metrics.reach[f].record(receipt.time - receipt.block->block().created());
+            }
+        }
+    }
+
+    // called by partition 0 between windows while the other partitions wait
+    void count_window_receipts(Partition &part) {
+        vector<BlockReceipt> receipts;
+        for (Partition *partition : _partitions) {
+            receipts.insert(receipts.end(), partition->metrics.receipts.begin(), partition->metrics.receipts.end());
+            partition->metrics.receipts.clear();
+        }
+        sort(receipts.begin(), receipts.end(), earlier_receipt);
+        for (const BlockReceipt &receipt : receipts) {
+            count_reach(part.metrics, receipt);
+        }
+    }
+
+    // deepest common ancestor of two blocks of the tree
+    static BlockNode* common_ancestor(BlockNode *a, BlockNode *b) {
+        if (a->height() > b->height()) {
+            a = a->ancestor(b->height());
+        } else {
+            b = b->ancestor(a->height());
+        }
+        while (a != b) {
+            a = a->parentNode();
+            b = b->parentNode();
+        }
+        return a;
+    }
+
+    // runs a pruning if one is due at time, between events or windows
+    void prune_if_due(Time time) {
+        if (_finality > 0 && time >= _nextPrune) {
+            prune();
+            _nextPrune = (floor(time / _pruneInterval) + 1) * _pruneInterval;
+        }
+    }
+
+    // blocks and transactions a pending event will deliver
+    void pin_event(const Event &event, vector<bool> &pinned, unordered_set<const Transaction*> &pinnedTxns) {
+        if (event.type == RECEIVE_TRANSACTION) {
+            pinnedTxns.insert(event.txn);
+        } else if (event.type == RECEIVE_BLOCK || event.type == RECEIVE_BLOCK_TXNS) {
+            pinned[event.block->index()] = true;
+        } else if (event.type == RECEIVE_INVENTORY) {
+            pinnedTxns.insert(event.txns->begin(), event.txns->end());
+        }
+    }
+
+    // frees the part of the block tree no node can leave anymore. the final
+    // block is the deepest one on every node's main chain at least _finality
+    // below every top; it becomes the root. freed are its ancestors with the
+    // transactions they confirmed and every branch forking off below it,
+    // except blocks and transactions that pending events or relay buffers
+    // still carry: the final block is lowered to the deepest ancestor one
+    // still carries, kept blocks of freed branches are detached and kept
+    // transactions are retried at the next pruning. every node's per block
+    // state moves to the renumbered tree. called while no event is being
+    // simulated
+    void prune() {
+        BlockNode *root = _store.genesis();
+        BlockNode *final = _nodeTable.top(0);
+        unsigned long lowest = final->height();
+        for (Id id = 0; id < _nodeTable.nodes(); id++) {
+            BlockNode *top = _nodeTable.top(id);
+            lowest = min(lowest, top->height());
+            final = common_ancestor(final, top);
+        }
+        if (lowest <= root->height() + _finality) {
+            return;
+        }
+        final = final->ancestor(min(final->height(), lowest - _finality));
+
+        uint32_t blocks = _store.blocks();
+        vector<bool> pinned(blocks, false);
+        unordered_set<const Transaction*> pinnedTxns;
+        vector<Event> events;
+        vector<uint64_t> keys;
+        for (Partition *partition : _partitions) {
+            partition->queue->pending_events(events, keys);
+        }
+        for (const Event &event : events) {
+            pin_event(event.type == FANOUT ? event.fanout->event : event, pinned, pinnedTxns);
+        }
+        for (const vector<const Transaction*> &buffer : _relayBuffers) {
+            pinnedTxns.insert(buffer.begin(), buffer.end());
+        }
+        for (BlockNode *block = final->parentNode(); block != NULL; block = block->parentNode()) {
+            if (pinned[block->index()]) {
+                final = block;
+            }
+        }
+        if (final == root) {
+            return;
+        }
+
+        // parents come before their children in index order
+        vector<bool> under(blocks, false), freedMain(blocks, false);
+        vector<uint32_t> children(blocks, 0);
+        for (BlockNode *block = final->parentNode(); block != NULL; block = block->parentNode()) {
+            freedMain[block->index()] = true;
+        }
+        vector<uint32_t> remap(blocks, NO_INDEX);
+        vector<BlockNode*> tree(1, final);
+        remap[final->index()] = 0;
+        for (uint32_t i = 0; i < blocks; i++) {
+            BlockNode *block = _store.block_node(i);
+            BlockNode *parent = block->parentNode();
+            if (parent != NULL) {
+                children[parent->index()]++;
+            }
+            under[i] = block == final || (parent != NULL && under[parent->index()] && !block->detached());
+            if ((under[i] || pinned[i]) && block != final) {
+                remap[i] = tree.size();
+                tree.push_back(block);
+            }
+        }
+        // a kept block may list a transaction of a freed one, as rejected
+        for (BlockNode *block : tree) {
+            const vector<const Transaction*> &txns = block->block().transactions();
+            pinnedTxns.insert(txns.begin(), txns.end());
+        }
+
+        // the transactions the freed main chain blocks confirmed. the
+        // rejected ones belong to a block the sender confirmed
+        vector<const Transaction*> confirmed, freedTxns;
+        confirmed.swap(_unfreedTxns);
+        for (BlockNode *block = final->parentNode(); block != NULL; block = block->parentNode()) {
+            const vector<const Transaction*> &txns = block->block().transactions();
+            const vector<uint32_t> &rejected = block->rejected();
+            size_t r = 0;
+            for (uint32_t t = 0; t < txns.size(); t++) {
+                if (r < rejected.size() && rejected[r] == t) {
+                    r++;
                 } else {
-                    _bottleneckSpeeds[i][j] = _bottleneckSpeeds[j][i] = 5;
+                    confirmed.push_back(txns[t]);
                 }
-                
-                // initialize propagation delay from a uniform distribution between 10ms and 500ms
-                _propDelays[i][j] = _propDelays[j][i] = uniformDistribution(_generator) / 1000.0;
             }
         }
+        vector<Id> freedIds;
+        for (const Transaction *txn : confirmed) {
+            if (pinnedTxns.count(txn)) {
+                _unfreedTxns.push_back(txn);
+            } else {
+                freedTxns.push_back(txn);
+                freedIds.push_back(txn->id());
+            }
+        }
+
+        // cut the links into freed blocks before the nodes look at detached()
+        for (BlockNode *block : tree) {
+            if (under[block->index()]) {
+                block->cut_below(final->height());
+            } else {
+                BlockNode *parent = block->parentNode();
+                block->detach(parent == NULL || remap[parent->index()] == NO_INDEX);
+            }
+        }
+
+        for (Node *node : _nodes) {
+            node->reindex(remap, freedIds);
+        }
+        if (!_reached.empty()) {
+            vector<uint32_t> reached(tree.size(), 0);
+            for (uint32_t i = 0; i < blocks && i < _reached.size(); i++) {
+                if (remap[i] != NO_INDEX) {
+                    reached[remap[i]] = _reached[i];
+                }
+            }
+            _reached.swap(reached);
+        }
+
+        size_t n = _nodes.size();
+        uint64_t freedBlocks = 0;
+        for (uint32_t i = 0; i < blocks; i++) {
+            BlockNode *block = _store.block_node(i);
+            if (remap[i] != NO_INDEX) {
+                continue;
+            }
+            freedBlocks++;
+            _pruned.forks += children[i] > 1;
+            _pruned.bytes += sizeof(Block) + sizeof(BlockNode) + block->block().transactions().size() * sizeof(Transaction*) +
+                             block->rejected().size() * sizeof(uint32_t);
+            Id id = block->id();
+            if (id != GENESIS_ID) {
+                size_t creator = (id - GENESIS_ID - 1) % n;
+                _pruned.blocks++;
+                if (freedMain[i]) {
+                    _pruned.mainBlocks++;
+                    _pruned.mainByCreator[creator]++;
+                }
+                _store.destroy_block(_owner[creator], block);
+            } else {
+                _store.destroy_block(0, block);
+            }
+        }
+        for (const Transaction *txn : freedTxns) {
+            _store.destroy_txn(_owner[txn->payer()], txn);
+        }
+        _pruned.txns += freedTxns.size();
+        // every node holds an arrival time and a connected and a heard bit
+        // per block of the tree, whichever partition it is in
+        _pruned.bytes += freedTxns.size() * sizeof(Transaction) + freedBlocks * n * sizeof(Time) + (freedBlocks * n * 2 + 7) / 8;
+        _pruned.prunes++;
+        _store.reindex(tree);
+    }
+
+    // reads the sections in the order save writes them
+    void restore(SnapshotReader &in, const Options &options) {
+        size_t n = in.nodes();
+        double txnRate = in.get<double>();
+        double blockRate = in.get<double>();
+        _links.load(in, n);
+        vector<uint64_t> keys, counters;
+        in.get_vector(keys);
+        in.get_vector(counters);
+        in.get_vector(_pushCounts);
+        if (keys.size() != _links.edges() || counters.size() != keys.size() || _pushCounts.size() != n) {
+            in.fail("bad network");
+            return;
+        }
+        _latency.restore(_links, keys, counters, _resolution);
+        _lookahead = _latency.min_latency();
+
+        unsigned long long *pruned[] = {&_pruned.prunes, &_pruned.blocks, &_pruned.mainBlocks, &_pruned.forks,
+                                        &_pruned.txns, &_pruned.bytes};
+        for (unsigned long long *count : pruned) {
+            *count = in.get<unsigned long long>();
+        }
+        in.get_vector(_pruned.mainByCreator);
+        in.get_txns(_unfreedTxns);
+        if (_pruned.mainByCreator.size() != n) {
+            in.fail("bad network");
+            return;
+        }
+
+        vector<const Transaction*> txns;
+        uint64_t blocks = in.get<uint64_t>();
+        for (uint64_t i = 0; i < blocks && in.ok(); i++) {
+            Id id = in.get<Id>();
+            Id parentId = in.get<Id>();
+            Time created = in.get<Time>();
+            bool hasParent = in.get<uint8_t>();
+            BlockNode *parent = hasParent ? in.get_block() : NULL;
+            uint64_t height = hasParent ? 0 : in.get<uint64_t>();
+            bool detached = in.get<uint8_t>();
+            in.get_txns(txns);
+            if (!in.ok() || (i == 0 && hasParent) || (!hasParent && height == 0)) {
+                in.fail("bad block");
+                return;
+            }
+            // the first block is the root, the genesis block unless the tree was pruned
+            BlockNode *block = i == 0 ? _store.replace_genesis(id, parentId, txns, created, height) :
+                               hasParent ? _store.create_block(0, id, parentId, txns, parent, created) :
+                               _store.create_parentless(0, id, parentId, txns, created, height);
+            if (detached) {
+                block->detach(false);
+            }
+            if (in.get<uint8_t>()) {
+                block->set_validated();
+            }
+            in.get_vector(block->rejected());
+        }
+        for (size_t id = 0; id < n && in.ok(); id++) {
+            _nodeTable.add(SLOW, 1, 1, 0);
+            _nodes.push_back(new Node(id, _nodeTable, n, _store.genesis(), options.blockSize, options.blockPolicy));
+            _nodes.back()->load(in);
+            _nodes.back()->scale_rates(txnRate > 0 ? _txnRate / txnRate : 1, blockRate > 0 ? _blockRate / blockRate : 1);
+            _nodes.back()->blockChain().limit_orphans(options.orphanLimit, options.orphanTtl);
+        }
+        _relayBuffers.resize(_links.edges());
+        for (size_t e = 0; e < _relayBuffers.size() && in.ok(); e++) {
+            in.get_txns(_relayBuffers[e]);
+        }
+        in.get_vector(_flushPending);
+        if (!in.ok() || _nodes.size() != n || _flushPending.size() != n) {
+            in.fail("bad network");
+            return;
+        }
+
+        start_run(options);
+        _miningEvents.assign(n, NO_EVENT);
+        for (uint64_t i = in.get<uint64_t>(); i > 0 && in.ok(); i--) {
+            uint64_t key;
+            Event event = load_event(in, key);
+            if (!in.ok()) {
+                break;
+            }
+            EventHandle handle = _partitions[_owner[event.node]]->queue->push(event, key);
+            if (event.type == CREATE_BLOCK) {
+                _miningEvents[event.node] = handle;
+            }
+        }
+        if (in.ok() && in.remaining() > 0) {
+            in.fail("trailing data in snapshot");
+        }
+    }
+
+    void save_event(SnapshotWriter &out, const Event &event, uint64_t key) {
+        out.put(event.time);
+        out.put(event.type);
+        out.put(event.node);
+        out.put(event.peer);
+        out.put(key);
+        if (event.type == RECEIVE_TRANSACTION) {
+            out.put_txn(event.txn);
+        } else if (event.type == RECEIVE_BLOCK || event.type == RECEIVE_BLOCK_TXNS) {
+            out.put_block(event.block);
+        } else if (event.type == RECEIVE_INVENTORY) {
+            out.put_txns(*event.txns);
+        }
+    }
+
+    Event load_event(SnapshotReader &in, uint64_t &key) {
+        Time time = in.get<Time>();
+        EventType type = in.get<EventType>();
+        Event event = create_event(time, type, in.get<Id>());
+        event.peer = in.get<Id>();
+        key = in.get<uint64_t>();
+        bool received = type != CREATE_TRANSACTION && type != CREATE_BLOCK && type != RELAY_FLUSH;
+        if (event.node >= _nodes.size() || type > RECEIVE_BLOCK_TXNS || (received && event.peer >= _nodes.size())) {
+            in.fail("bad event");
+        } else if (event.type == RECEIVE_TRANSACTION) {
+            event.txn = in.get_txn();
+        } else if (event.type == RECEIVE_BLOCK || event.type == RECEIVE_BLOCK_TXNS) {
+            event.block = in.get_block();
+        } else if (event.type == RECEIVE_INVENTORY) {
+            event.txns = new vector<const Transaction*>();
+            in.get_txns(*event.txns);
+        }
+        return event;
+    }
+
+    // edge from node to peer, links().end(node) if they are not connected
+    size_t edge_to(Id node, Id peer) const {
+        size_t e = _links.begin(node);
+        while (e < _links.end(node) && _links.neighbor(e) != peer) {
+            e++;
+        }
+        return e;
     }
 
-    Time get_latency(Id i, Id j, int size_m) {
-        std::exponential_distribution<double> expDistribution(_bottleneckSpeeds[i][j] / 0.12);
-        double latency = _propDelays[i][j] + (size_m / _bottleneckSpeeds[i][j]) + expDistribution(_generator);
-        return floor(latency);
+    void add_link(vector<Link> &links, vector<int> &degrees, Id i, Id j) {
+        Link link = {i, j, 0, 0};
+        links.push_back(link);
+        degrees[i]++;
+        degrees[j]++;
+    }
+
+    // sets the attributes of the links between peers
+    void initialize_parameters(vector<Link> &links) {
+        for (Link &link : links) {
+            // if both nodes are fast, link speed is 100 Mbps else it is 5 Mbps
+            if (_nodes[link.a]->type() == FAST && _nodes[link.b]->type() == FAST) {
+                link.bandwidth = 100;
+            } else {
+                link.bandwidth = 5;
+            }
+
+            // initialize propagation delay from a uniform distribution between 10ms and 500ms
+            link.propDelay = (10 + _stream.below(491)) / 1000.0;
+        }
+    }
+
+    // tie breaking key of the next event scheduled by node. it only depends on
+    // the node's own history, so simultaneous events are ordered the same way
+    // no matter how the nodes are partitioned
+    uint64_t order_key(Id node) {
+        return ((uint64_t) node << 40) | _pushCounts[node]++;
+    }
+
+    // queues one receiver's event of a broadcast. with lazy delivery the
+    // receivers in part join fanout, which start_fanout queues afterwards
+    void send(Partition &part, const Event &event, uint64_t key, Fanout *fanout) {
+        if (fanout == NULL || _owner[event.node] != part.index) {
+            schedule(part, event, key);
+            return;
+        }
+        Delivery delivery = {event.time, key, event.node};
+        fanout->event = event;
+        fanout->deliveries.push_back(delivery);
+    }
+
+    // queues a broadcast's deliveries as one event keyed by the earliest
+    void start_fanout(Partition &part, Fanout *fanout) {
+        vector<Delivery> &deliveries = fanout->deliveries;
+        if (deliveries.size() < 2) {
+            if (!deliveries.empty()) {
+                Event event = fanout->event;
+                event.time = deliveries[0].time;
+                event.node = deliveries[0].node;
+                part.queue->push(event, deliveries[0].key);
+            }
+            part.release_fanout(fanout);
+            return;
+        }
+        sort(deliveries.begin(), deliveries.end(), earlier_delivery);
+        Event event = create_event(deliveries[0].time, FANOUT, fanout->event.peer);
+        event.fanout = fanout;
+        part.queue->push(event, deliveries[0].key);
+    }
+
+    // the event of a broadcast's next delivery. the FANOUT event goes back
+    // into the queue under the following delivery's time and key
+    Event next_delivery(Partition &part, const Event &event) {
+        Fanout *fanout = event.fanout;
+        const Delivery &delivery = fanout->deliveries[fanout->next++];
+        Event received = fanout->event;
+        received.time = delivery.time;
+        received.node = delivery.node;
+        if (fanout->next < fanout->deliveries.size()) {
+            const Delivery &following = fanout->deliveries[fanout->next];
+            Event rekeyed = event;
+            rekeyed.time = following.time;
+            part.queue->push(rekeyed, following.key);
+        } else {
+            part.release_fanout(fanout);
+        }
+        return received;
+    }
+
+    // queues an event scheduled by the node being simulated in part
+    void schedule(Partition &part, const Event &event, uint64_t key) {
+        size_t owner = _owner[event.node];
+        if (owner == part.index) {
+            part.queue->push(event, key);
+        } else {
+            Message message = {event, key};
+            part.outbox[owner].push_back(message);
+            part.stats.messages++;
+        }
     }
 
     void initialize_events() {
+        _started = true;
+        _miningEvents.assign(_nodes.size(), NO_EVENT);
         for (Node *node : _nodes) {
-            _eventsQueue.push(new Event(node->txnCreationTime(), CREATE_TRANSACTION, NULL, NULL, -1, -1, node->id()));
-            _eventsQueue.push(new Event(node->blockCreationTime(), CREATE_BLOCK, NULL, NULL, -1, -1, node->id()));
+            EventQueue *queue = _partitions[_owner[node->id()]]->queue;
+            queue->push(create_event(node->txnCreationTime(), CREATE_TRANSACTION, node->id()), order_key(node->id()));
+            _miningEvents[node->id()] = queue->push(create_event(node->blockCreationTime(), CREATE_BLOCK, node->id()), order_key(node->id()));
         }
     }
 
-    void create_transaction(Event *event) {
-        Id creatorId = event->creatorId();
-        Id payee = rand() % _nodes.size(); // random payee
-        Node *creator = _nodes[creatorId];
-        Transaction *txn = creator->create_new_transaction(payee);
-        int size_m = 0;
-        for (Id nbr : creator->nbrs()) {
-            Time otime = event->occurenceTime() + get_latency(creatorId, nbr, size_m);
-            _eventsQueue.push(new Event(otime, RECEIVE_TRANSACTION, txn, NULL, creatorId, nbr, -1));
+    void dispatch(Partition &part, const Event &event) {
+        if (event.type == FANOUT) {
+            dispatch(part, next_delivery(part, event));
+            return;
+        }
+        if (_measuring) {
+            sample_mempools(part, event.time);
+        }
+        part.stats.events++;
+        part.stats.lastTime = event.time;
+        if (_tracing) {
+            _tracer.log(TRACE_EVENT_BEGIN, event.time, 0, part.stats.events, 0, 0);
         }
+        PROFILE(uint64_t begin = cycle_count();)
+        switch(event.type) {
+            case CREATE_TRANSACTION:
+                create_transaction(part, event);
+                part.stats.ctc++;
+                break;
+            case CREATE_BLOCK:
+                create_block(part, event);
+                part.stats.cbc++;
+                break;
+            case RECEIVE_TRANSACTION:
+                receive_transaction(part, event);
+                part.stats.rtc++;
+                break;
+            case RECEIVE_BLOCK:
+                receive_block(part, event);
+                part.stats.rbc++;
+                break;
+            case RELAY_FLUSH:
+                flush_relay(part, event);
+                part.stats.flushes++;
+                break;
+            case RECEIVE_INVENTORY:
+                receive_inventory(part, event);
+                part.stats.inventories++;
+                break;
+            case RECEIVE_BLOCK_TXNS:
+                receive_block(part, event);
+                break;
+            default:
+                assert(false); // should not come here
+        }
+        PROFILE(profile_event(part, event, begin);)
+        if (_tracing) {
+            _tracer.log(TRACE_EVENT_END, event.time, 0, part.stats.events, 0, 0);
+        }
+    }
 
-        // add a new event which creates a new transaction by this node at updated txn creation time
-        _eventsQueue.push(new Event(creator->txnCreationTime(), CREATE_TRANSACTION, NULL, NULL, -1, -1, creatorId));
+    void run_sequential(unsigned long long maxEvents) {
+        Partition &part = *_partitions[0];
+        Event event;
+        Time time;
+        while (part.stats.events < maxEvents && part.queue->next_time(time) && time <= _until) {
+            prune_if_due(time);
+            PROFILE(uint64_t begin = cycle_count();)
+            part.queue->pop(event);
+            PROFILE(part.profile.popCycles += cycle_count() - begin;)
+            dispatch(part, event);
+        }
+    }
 
-        cout << "Create Transaction " << txn->id() << ": " << txn->payer() << "->" << txn->payee() << ", " << txn->amount() << endl;
+    // conservative parallel simulation. a message sent at time t arrives no
+    // earlier than t + lookahead, so once every partition knows the earliest
+    // pending event time T, all events before T + lookahead can be simulated
+    // independently. messages to other partitions are exchanged at the window
+    // barrier.
+    void run_parallel(unsigned long long maxEvents) {
+        size_t p = _partitions.size();
+        Barrier barrier(p);
+        vector<Time> next(p);
+        vector<unsigned long long> done(p);
+        vector<thread> workers;
+        for (size_t i = 1; i < p; i++) {
+            workers.push_back(thread(&Network::run_partition, this, ref(*_partitions[i]),
+                                     ref(barrier), ref(next), ref(done), maxEvents));
+        }
+        run_partition(*_partitions[0], barrier, next, done, maxEvents);
+        for (thread &worker : workers) {
+            worker.join();
+        }
     }
 
-    void create_block(Event *event) {
-        Id creatorId = event->creatorId();
-        Node *creator = _nodes[creatorId];
-        if (creator->blockCreationTime() == event->occurenceTime()) {
-            Block *block = creator->create_new_block();
-            if (block == NULL) {
-                cout << "No unspent transactions, block could not be created" << endl;
-            } else {
-                int size_m = 100;
-                for (Id nbr : creator->nbrs()) {
-                    Time otime = event->occurenceTime() + get_latency(creatorId, nbr, size_m);
-                    _eventsQueue.push(new Event(otime, RECEIVE_BLOCK, NULL, block, creatorId, nbr, -1));
+    void run_partition(Partition &part, Barrier &barrier, vector<Time> &next,
+                       vector<unsigned long long> &done, unsigned long long maxEvents) {
+        Event event;
+        Time time;
+        while (true) {
+            // take in the events other partitions sent during the last window
+            for (Partition *sender : _partitions) {
+                vector<Message> &inbox = sender->outbox[part.index];
+                for (const Message &message : inbox) {
+                    part.queue->push(message.event, message.key);
                 }
-                cout << "Create Block " << block->id() << ": " << creatorId << endl;
+                inbox.clear();
             }
+            next[part.index] = part.queue->next_time(time) ? time : numeric_limits<double>::infinity();
+            done[part.index] = part.stats.events;
+            barrier.wait();
 
-            // add a new event for creation of new block by this node at update block creation time
-            _eventsQueue.push(new Event(creator->blockCreationTime(), CREATE_BLOCK, NULL, NULL, -1, -1, creatorId));
+            // every partition reaches the same decision from the same values
+            Time start = *min_element(next.begin(), next.end());
+            unsigned long long total = 0;
+            for (unsigned long long count : done) {
+                total += count;
+            }
+            if (start == numeric_limits<double>::infinity() || start > _until || total >= maxEvents) {
+                break;
+            }
+            // the other partitions wait while partition 0 prunes
+            if (_finality > 0 && start >= _nextPrune) {
+                barrier.wait();
+                if (part.index == 0) {
+                    prune_if_due(start);
+                }
+                barrier.wait();
+            }
+            Time horizon = start + _lookahead;
+            part.stats.windows++;
+            while (part.queue->next_time(time) && time < horizon && time <= _until) {
+                PROFILE(uint64_t begin = cycle_count();)
+                part.queue->pop(event);
+                PROFILE(part.profile.popCycles += cycle_count() - begin;)
+                dispatch(part, event);
+            }
+            barrier.wait();
+            if (_measuring && part.index == 0) {
+                count_window_receipts(part);
+            }
+        }
+    }
+
+    void create_transaction(Partition &part, const Event &event) {
+        Id creatorId = event.node;
+        Node *creator = _nodes[creatorId];
+        Id payee = creator->stream().below(_nodes.size()); // random payee
+        const Transaction *txn = creator->create_new_transaction(payee, _store.shard(part.index));
+        PROFILE(part.profile.txnBytes += sizeof(Transaction);)
+        relay_transaction(part, event.time, txn, creatorId, creatorId);
+
+        // add a new event which creates a new transaction by this node at updated txn creation time
+        part.queue->push(create_event(creator->txnCreationTime(), CREATE_TRANSACTION, creatorId), order_key(creatorId));
+
+        if (_tracing) {
+            _tracer.log(TRACE_CREATE_TXN, event.time, txn->amount(), txn->id(), txn->payer(), txn->payee());
+        }
+    }
+
+    void create_block(Partition &part, const Event &event) {
+        Id creatorId = event.node;
+        Node *creator = _nodes[creatorId];
+        // the pending mining event is moved whenever the creation time changes
+        assert(creator->blockCreationTime() == event.time);
+        BlockNode *block = creator->create_new_block(_store, part.index);
+        if (block == NULL) {
+            if (_tracing) {
+                _tracer.log(TRACE_NO_TXNS, event.time, creator->blockCreationTime(), 0, creatorId, 0);
+            }
+        } else {
+            PROFILE(part.profile.blockBytes += sizeof(Block) + sizeof(BlockNode) +
+                                               block->block().transactions().size() * sizeof(const Transaction*);)
+            if (_measuring) {
+                block_accepted(part, block, creatorId, event.time);
+            }
+            relay_block(part, event.time, block, creatorId, creatorId);
+            if (_tracing) {
+                _tracer.log(TRACE_CREATE_BLOCK, event.time, 0, block->id(), creatorId, 0);
+            }
         }
+
+        // add a new event for creation of new block by this node at update block creation time
+        _miningEvents[creatorId] = part.queue->push(create_event(creator->blockCreationTime(), CREATE_BLOCK, creatorId), order_key(creatorId));
     }
 
-    void receive_transaction(Event *event) {
-        Id senderId = event->senderId();
-        Id receiverId = event->receiverId();
-        Transaction *txn = event->txn();
+    void receive_transaction(Partition &part, const Event &event) {
+        Id senderId = event.peer;
+        Id receiverId = event.node;
+        const Transaction *txn = event.txn;
         Node *receiver = _nodes[receiverId];
-        
-        cout << "Receive Transaction " << txn->id() << ": " << receiverId << "<-" << senderId << " ";
-        
+
         // if the transaction is not already heard from any other connected peer
         if (!receiver->has_heard_txn(txn->id())) {
             receiver->receive_transaction(txn);
-            int size_m = 0;
-            // broadcast the transaction to all the connected peers except the peer who sent the transaction
-            for (Id nbr : receiver->nbrs()) {
-                if (nbr == senderId) {
-                    continue;
-                }
-                Time otime = event->occurenceTime() + get_latency(receiverId, nbr, size_m);
-                _eventsQueue.push(new Event(otime, RECEIVE_TRANSACTION, txn, NULL, receiverId, nbr, -1));
+            relay_transaction(part, event.time, txn, receiverId, senderId);
+            if (_tracing) {
+                _tracer.log(TRACE_RECEIVE_TXN, event.time, 0, txn->id(), receiverId, senderId, TRACE_ACCEPTED);
+            }
+            if (_measuring) {
+                part.metrics.txnReceipts++;
+                part.metrics.txnLatency.record(event.time - txn->created());
             }
-            cout << "Successful" << endl;
         } else {
-            cout << "Rejected" << endl;
+            if (_tracing) {
+                _tracer.log(TRACE_RECEIVE_TXN, event.time, 0, txn->id(), receiverId, senderId);
+            }
+            part.metrics.duplicateTxns++;
+        }
+    }
+
+    // a RECEIVE_BLOCK_TXNS event completes a compact block the node has already
+    // marked as heard
+    void receive_block(Partition &part, const Event &event) {
+        Id senderId = event.peer;
+        Id receiverId = event.node;
+        BlockNode *block = event.block;
+        Node *receiver = _nodes[receiverId];
+
+        // if the block is already heard from any other connected peer
+        if (event.type == RECEIVE_BLOCK && receiver->has_heard_block(block)) {
+            if (_tracing) {
+                _tracer.log(TRACE_RECEIVE_BLOCK, event.time, 0, block->id(), receiverId, senderId);
+            }
+            part.metrics.duplicateBlocks++;
+            return;
+        }
+        if (_compactBlocks && event.type == RECEIVE_BLOCK) {
+            // rebuild the block from the transactions heard so far, fetch the rest from the sender
+            size_t missing = 0;
+            for (const Transaction *txn : block->block().transactions()) {
+                missing += !receiver->has_heard_txn(txn->id());
+            }
+            if (missing > 0) {
+                receiver->hear_block(block);
+                size_t e = edge_to(receiverId, senderId);
+                Time otime = event.time + get_latency(e, REQUEST_SIZE) + get_latency(e, TXN_SIZE * missing);
+                Event completion = receive_block_event(otime, block, senderId, receiverId);
+                completion.type = RECEIVE_BLOCK_TXNS;
+                part.queue->push(completion, order_key(receiverId));
+                PROFILE(part.profile.fanout[receiverId]++;)
+                part.stats.compactMisses++;
+                return;
+            }
+        }
+        if (_compactBlocks) {
+            part.stats.compactBlocks++;
+        }
+
+        unsigned long long reorgs = receiver->ledger().reorgs();
+        unsigned long long undone = receiver->ledger().undone();
+        bool connected = block->detached() ? receiver->receive_detached(block, event.time)
+                                           : receiver->receive_block(block, event.time);
+        if (_measuring) {
+            part.metrics.blockReceipts++;
+            part.metrics.orphanReceipts += !connected;
+            part.metrics.blockLatency.record(event.time - block->block().created());
+            if (receiver->ledger().reorgs() > reorgs) {
+                part.metrics.reorgDepth.record(receiver->ledger().undone() - undone);
+            }
+            block_accepted(part, block, receiverId, event.time);
+        }
+        // receiving a block restarts mining on the new top
+        Time miningTime = receiver->blockCreationTime();
+        if (!part.queue->reschedule(_miningEvents[receiverId], miningTime, order_key(receiverId))) {
+            _miningEvents[receiverId] = part.queue->push(create_event(miningTime, CREATE_BLOCK, receiverId), order_key(receiverId));
+        }
+        relay_block(part, event.time, block, receiverId, senderId);
+        if (_tracing) {
+            _tracer.log(TRACE_RECEIVE_BLOCK, event.time, 0, block->id(), receiverId, senderId,
+                        TRACE_ACCEPTED | (connected ? 0 : TRACE_ORPHAN));
+        }
+    }
+
+    void flush_relay(Partition &part, const Event &event) {
+        Id nodeId = event.node;
+        _flushPending[nodeId] = 0;
+        for (size_t e = _links.begin(nodeId); e < _links.end(nodeId); e++) {
+            if (!_relayBuffers[e].empty()) {
+                send_inventory(part, event.time, e, nodeId);
+            }
         }
     }
 
-    void receive_block(Event *event) {
-        Id senderId = event->senderId();
-        Id receiverId = event->receiverId();
-        Block *block = event->block();
+    void receive_inventory(Partition &part, const Event &event) {
+        Id senderId = event.peer;
+        Id receiverId = event.node;
         Node *receiver = _nodes[receiverId];
-        
-        cout << "Receive Block " << block->id() << ": " << receiverId << "<-" << senderId << " ";
-        
-        // if the block is not already heard from any other connected peer
-        if (!receiver->has_heard_block(block->id())) {
-            receiver->receive_block(block, event->occurenceTime());
-            int size_m = 100;
-            // broadcast the block to all the connected peers except the peer who sent the block
-            for (Id nbr : receiver->nbrs()) {
-                if (nbr == senderId) {
-                    continue;
+        part.stats.inventoryTxns += event.txns->size();
+        for (const Transaction *txn : *event.txns) {
+            if (!receiver->has_heard_txn(txn->id())) {
+                receiver->receive_transaction(txn);
+                relay_transaction(part, event.time, txn, receiverId, senderId);
+                if (_tracing) {
+                    _tracer.log(TRACE_RECEIVE_TXN, event.time, 0, txn->id(), receiverId, senderId, TRACE_ACCEPTED);
                 }
-                Time otime = event->occurenceTime() + get_latency(receiverId, nbr, size_m);
-                _eventsQueue.push(new Event(otime, RECEIVE_BLOCK, NULL, block, receiverId, nbr, -1));
+                if (_measuring) {
+                    part.metrics.txnReceipts++;
+                    part.metrics.txnLatency.record(event.time - txn->created());
+                }
+            } else {
+                if (_tracing) {
+                    _tracer.log(TRACE_RECEIVE_TXN, event.time, 0, txn->id(), receiverId, senderId);
+                }
+                part.metrics.duplicateTxns++;
             }
-            cout << "Successful" << endl;
-        } else {
-            cout << "Rejected" << endl;
+        }
+        delete event.txns;
+    }
+
+    // passes a transaction nodeId has just heard on to its peers except senderId,
+    // at once or through the link buffers
+    void relay_transaction(Partition &part, Time time, const Transaction *txn, Id nodeId, Id senderId) {
+        size_t begin = _links.begin(nodeId);
+        Fanout *fanout = NULL;
+        if (!_batchRelay) {
+            get_latencies(nodeId, senderId, TXN_SIZE, part.latencies);
+            fanout = _lazyDelivery ? part.new_fanout() : NULL;
+        }
+        for (size_t e = begin; e < _links.end(nodeId); e++) {
+            Id nbr = _links.neighbor(e);
+            if (nbr == senderId) {
+                continue;
+            }
+            if (!_batchRelay) {
+                send(part, receive_txn_event(time + part.latencies[e - begin], txn, nodeId, nbr), order_key(nodeId), fanout);
+                PROFILE(part.profile.fanout[nodeId]++;)
+                continue;
+            }
+            _relayBuffers[e].push_back(txn);
+            if (_relayBuffers[e].size() >= _relayBatch) {
+                send_inventory(part, time, e, nodeId);
+            }
+        }
+        if (fanout != NULL) {
+            start_fanout(part, fanout);
+        }
+        if (_batchRelay && !_flushPending[nodeId]) {
+            _flushPending[nodeId] = 1;
+            part.queue->push(create_event(time + _relayInterval, RELAY_FLUSH, nodeId), order_key(nodeId));
+        }
+    }
+
+    // sends the transactions buffered on edge as one message
+    void send_inventory(Partition &part, Time time, size_t edge, Id nodeId) {
+        vector<const Transaction*> *txns = new vector<const Transaction*>();
+        txns->swap(_relayBuffers[edge]);
+        Time otime = time + get_latency(edge, TXN_SIZE * txns->size());
+        schedule(part, receive_inventory_event(otime, txns, nodeId, _links.neighbor(edge)), order_key(nodeId));
+        PROFILE(
+            part.profile.fanout[nodeId]++;
+            part.profile.inventoryBytes += sizeof(*txns) + txns->capacity() * sizeof(const Transaction*);
+        )
+    }
+
+    // broadcasts a block nodeId has accepted to its peers except senderId
+    void relay_block(Partition &part, Time time, BlockNode *block, Id nodeId, Id senderId) {
+        size_t begin = _links.begin(nodeId);
+        get_latencies(nodeId, senderId, _compactBlocks ? COMPACT_BLOCK_SIZE : BLOCK_SIZE, part.latencies);
+        Fanout *fanout = _lazyDelivery ? part.new_fanout() : NULL;
+        for (size_t e = begin; e < _links.end(nodeId); e++) {
+            Id nbr = _links.neighbor(e);
+            if (nbr == senderId) {
+                continue;
+            }
+            send(part, receive_block_event(time + part.latencies[e - begin], block, nodeId, nbr), order_key(nodeId), fanout);
+            PROFILE(part.profile.fanout[nodeId]++;)
+        }
+        if (fanout != NULL) {
+            start_fanout(part, fanout);
         }
     }
 };
@@ -5,127 +5,239 @@
 #include <time.h>
 #include <cstdlib>
 #include <cmath>
-#include <unordered_set>
-#include <random>
 #include "types.h"
+#include "rng.h"
 #include "blockchain.h"
+#include "store.h"
+#include "mempool.h"
+#include "ledger.h"
+#include "snapshot.h"
+#include "seenfilter.h"
+#include "nodetable.h"
 
 using namespace std;
 
-typedef unsigned int NodeType;
-const NodeType SLOW = 0;
-const NodeType FAST = 1;
-
+// a node's heavyweight containers. its scalar state is the row id of the
+// NodeTable, which the node reads and updates in place
 class Node {
 public:
-    Node(Id id, NodeType nodeType, double txnCreationRate, double blockCreationRate) :
-        _txnCreationDistribution(txnCreationRate), _blockCreationDistribution(blockCreationRate), _generator(time(NULL))
+    // the row must have been added to table. the node owns heardTxns, an
+    // exact bitmap if it is NULL
+    Node(Id id, NodeTable &table, size_t networkSize, BlockNode *genesis, size_t maxBlockTxns = 0,
+         int blockPolicy = SELECT_OLDEST, SeenFilter *heardTxns = NULL) :
+        _table(table), _blockChain(genesis), _ledger(100),
+        _heardTxns(heardTxns != NULL ? heardTxns : new BitmapSeenFilter()), _maxBlockTxns(maxBlockTxns),
+        _blockPolicy(blockPolicy)
     {
         _id = id;
-        _nodeType = nodeType;
-        _money = 100;
-        _txnCreationTime = _txnCreationDistribution(_generator);
-        _blockCreationTime = _blockCreationDistribution(_generator);
+        _networkSize = networkSize;
+        _ledger.move_to(_blockChain.top(), _unspentTxns);
+        publish_top();
+        _table.txn_time(_id) = stream().exponential(_table.txn_rate(_id));
+        _table.block_time(_id) = stream().exponential(_table.block_rate(_id));
     }
 
-    Id id() const { return _id; }
+    ~Node() {
+        delete _heardTxns;
+    }
 
-    NodeType type() const { return _nodeType; }
+    Id id() const { return _id; }
 
-    vector<Id>& nbrs() { return _nbrs; }
+    NodeType type() const { return _table.type(_id); }
 
     BlockChain& blockChain() { return _blockChain; }
 
-    Time txnCreationTime() const { return _txnCreationTime; }
+    Time txnCreationTime() const { return _table.txn_time(_id); }
 
-    Time blockCreationTime() const { return _blockCreationTime; } 
+    Time blockCreationTime() const { return _table.block_time(_id); }
 
-    void add_neighbor(Id nbr) {
-        _nbrs.push_back(nbr);
-    }
+    // random stream of this node
+    Stream& stream() { return _table.stream(_id); }
+
+    // balance on this node's main chain
+    Coin money() const { return _table.balance(_id); }
+
+    const Ledger& ledger() const { return _ledger; }
+
+    size_t unspent_txns() const { return _unspentTxns.size(); }
+
+    unsigned long long blocks_created() const { return _table.block_count(_id); }
 
     bool has_heard_txn(Id txnId) {
-        return _heardTxns.count(txnId);
+        return _heardTxns->contains(txnId);
     }
 
-    bool has_heard_block(Id blockId) {
-        return _heardBlocks.count(blockId);
+    const SeenFilter& heard_txns() const { return *_heardTxns; }
+
+    bool has_heard_block(const BlockNode *block) {
+        uint32_t i = block->index();
+        return i / 64 < _heardBlocks.size() && (_heardBlocks[i / 64] >> (i % 64) & 1);
     }
 
-    void receive_transaction(Transaction *txn) {
-        _unspentTxns.push_back(*txn);
-        _heardTxns.insert(txn->id());
+    // calls f(index) for every block heard so far, in increasing index order
+    template <typename F>
+    void for_each_heard_block(F f) const {
+        for (size_t w = 0; w < _heardBlocks.size(); w++) {
+            for (uint64_t bits = _heardBlocks[w]; bits != 0; bits &= bits - 1) {
+                f((uint32_t) (w * 64 + __builtin_ctzll(bits)));
+            }
+        }
     }
 
-    void receive_block(Block *block, Time arrivalTime) {
-        if (!_blockChain.add_block(*block, arrivalTime)) {
-            cout << "blockchain can not receive block " << block->id() << endl;
+    // marks the block as heard without adding it to the blockchain yet
+    void hear_block(const BlockNode *block) {
+        if (block->index() / 64 >= _heardBlocks.size()) {
+            _heardBlocks.resize(block->index() / 64 + 1, 0);
         }
-        _heardBlocks.insert(block->id());
-        _blockCreationTime = arrivalTime + _blockCreationDistribution(_generator); // update block creation time
-        
-        // remove transactions in the received block from unspent transactions list
-        vector<Transaction> blockTxns = block->transactions();
-        for (Transaction txn : blockTxns) {
-            remove_txn(txn.id());   // remove txn from unspent txn list
-            Coin amount = txn.amount(); // txn amount
-            // update money of this node if it is involved in any txn
-            if (_id == txn.payee()) {
-                _money += amount;
-            } else if (_id == txn.payer()) {
-                _money -= amount;
-            } 
+        _heardBlocks[block->index() / 64] |= 1ULL << (block->index() % 64);
+    }
+
+    void receive_transaction(const Transaction *txn) {
+        if (!_ledger.confirmed(txn->id())) {
+            _unspentTxns.insert(txn);
         }
+        _heardTxns->insert(txn->id());
     }
 
-    Transaction* create_new_transaction(Id payee) {
-        double percentage = (rand() % 50) / 100.0;
-        Coin amount = _money * percentage;
-        Transaction *txn = new Transaction(_id, payee, amount);
+    // returns false if the block's parent is not in the blockchain yet
+    bool receive_block(BlockNode *block, Time arrivalTime) {
+        bool connected = _blockChain.add_block(block, arrivalTime);
+        hear_block(block);
+        _table.block_time(_id) = arrivalTime + stream().exponential(_table.block_rate(_id)); // update block creation time
+
+        // balances and unspent transactions follow the top, also across a fork switch
+        if (_blockChain.top() != _ledger.tip()) {
+            _ledger.move_to(_blockChain.top(), _unspentTxns);
+        }
+        publish_top();
+        return connected;
+    }
+
+    // a block whose branch was pruned away: heard and relayed like any other,
+    // but it can not join the blockchain. returns false like an orphan
+    bool receive_detached(const BlockNode *block, Time arrivalTime) {
+        hear_block(block);
+        _table.block_time(_id) = arrivalTime + stream().exponential(_table.block_rate(_id)); // update block creation time
+        return false;
+    }
+
+    // follows a pruning of the shared tree, see BlockChain::reindex. the
+    // freed transactions can not be received again, so they are forgotten
+    void reindex(const vector<uint32_t> &remap, const vector<Id> &freedTxns) {
+        _blockChain.reindex(remap);
+        vector<uint64_t> heardBlocks;
+        for_each_heard_block([&remap, &heardBlocks](uint32_t i) {
+            uint32_t j = remap[i];
+            if (j == NO_INDEX) {
+                return;
+            }
+            if (j / 64 >= heardBlocks.size()) {
+                heardBlocks.resize(j / 64 + 1, 0);
+            }
+            heardBlocks[j / 64] |= 1ULL << (j % 64);
+        });
+        heardBlocks.shrink_to_fit();
+        _heardBlocks.swap(heardBlocks);
+        for (Id id : freedTxns) {
+            _heardTxns->forget(id);
+        }
+        _ledger.forget(freedTxns);
+    }
+
+    // the transaction is allocated once in shard and shared by pointer
+    const Transaction* create_new_transaction(Id payee, ObjectStore::Shard &shard) {
+        double percentage = stream().below(50) / 100.0;
+        Coin amount = money() * percentage;
+        Id txnId = creator_scoped_id(_table.txn_count(_id)++, _id, _networkSize);
+        Time &creationTime = _table.txn_time(_id);
+        const Transaction *txn = shard.txns.create(txnId, _id, payee, amount, creationTime);
         receive_transaction(txn);
-        _txnCreationTime += _txnCreationDistribution(_generator);
+        creationTime += stream().exponential(_table.txn_rate(_id));
         return txn;
     }
 
-    Block* create_new_block() {
-        // if there are no unspent transactions then do not create a block
-        if (_unspentTxns.size() == 0) {
-            _blockCreationTime += _blockCreationDistribution(_generator); // update block creation time
-            cout << "new block creation time = " << _blockCreationTime << endl;
+    // the block and its tree node are allocated once in shard and shared by pointer
+    BlockNode* create_new_block(ObjectStore &store, size_t shard) {
+        // if there are no valid unspent transactions then do not create a block
+        _unspentTxns.select(_maxBlockTxns, _blockPolicy, _blockTxns);
+        _ledger.filter_valid(_blockTxns);
+        if (_blockTxns.empty()) {
+            _table.block_time(_id) += stream().exponential(_table.block_rate(_id)); // update block creation time
             return NULL;
         }
         BlockNode *topNode = _blockChain.top();
         Id parentId = topNode->block().id();
-        Block *block = new Block(parentId, _unspentTxns);
-        _unspentTxns.clear();
-        receive_block(block, _blockCreationTime);
+        Id blockId = GENESIS_ID + 1 + creator_scoped_id(_table.block_count(_id)++, _id, _networkSize);
+        Time created = _table.block_time(_id);
+        BlockNode *block = store.create_block(shard, blockId, parentId, _blockTxns, topNode, created);
+        receive_block(block, created);
         return block;
     }
 
+    // multiplies both creation rates, the pending creation times stay
+    void scale_rates(double txnFactor, double blockFactor) {
+        _table.txn_rate(_id) *= txnFactor;
+        _table.block_rate(_id) *= blockFactor;
+    }
+
+    // the block size, block policy and orphan limits are run settings and
+    // not part of the snapshot
+    void save(SnapshotWriter &out) const {
+        out.put(_table.type(_id));
+        out.put(_table.txn_count(_id));
+        out.put(_table.block_count(_id));
+        _blockChain.save(out);
+        _unspentTxns.save(out);
+        _ledger.save(out);
+        save_seen_filter(out, *_heardTxns);
+        out.put_vector(_heardBlocks);
+        out.put(_table.txn_time(_id));
+        out.put(_table.block_time(_id));
+        out.put(_table.stream(_id).key());
+        out.put(_table.stream(_id).counter());
+        out.put(_table.txn_rate(_id));
+        out.put(_table.block_rate(_id));
+    }
+
+    void load(SnapshotReader &in) {
+        _table.type(_id) = in.get<NodeType>();
+        _table.txn_count(_id) = in.get<unsigned long long>();
+        _table.block_count(_id) = in.get<unsigned long long>();
+        _blockChain.load(in);
+        _unspentTxns.load(in);
+        _ledger.load(in);
+        SeenFilter *heardTxns = load_seen_filter(in);
+        if (heardTxns != NULL) {
+            delete _heardTxns;
+            _heardTxns = heardTxns;
+        }
+        in.get_vector(_heardBlocks);
+        _table.txn_time(_id) = in.get<Time>();
+        _table.block_time(_id) = in.get<Time>();
+        uint64_t key = in.get<uint64_t>();
+        _table.stream(_id) = Stream(key, in.get<uint64_t>());
+        _table.txn_rate(_id) = in.get<double>();
+        _table.block_rate(_id) = in.get<double>();
+        publish_top();
+    }
 
 private:
-    Id _id; // unique id
-    NodeType _nodeType; // slow/fast
-    Coin _money;
-    vector<Id> _nbrs; // connected peers
+    Id _id; // unique id, the node's row in _table
+    NodeTable &_table; // type, rates, creation times and counts, stream, top and balance
+    size_t _networkSize; // stride of the creator scoped ids
     BlockChain _blockChain;
-    vector<Transaction> _unspentTxns; // unspent transactions
-    unordered_set<Id> _heardTxns; // transaction received so far (including those not in blockchain)
-    unordered_set<Id> _heardBlocks; // blocks received so far (all blocks in blockchain)
-    Time _txnCreationTime; // time when a new transaction should be created
-    Time _blockCreationTime; // time when a new block should be created
-    std::default_random_engine _generator;
-    std::exponential_distribution<double> _txnCreationDistribution; // distribution for txn interarrival
-    std::exponential_distribution<double> _blockCreationDistribution; // distribution for waiting time for block creation
-
-    void remove_txn(Id txnId) {
-        for (int i = 0; i < _unspentTxns.size(); i++) {
-            if (_unspentTxns[i].id() == txnId) {
-                _unspentTxns[i] = _unspentTxns.back();
-                _unspentTxns.pop_back();
-                break;
-            }
-        }
+    Mempool _unspentTxns; // unspent transactions
+    Ledger _ledger; // balances as of the top of _blockChain
+    vector<const Transaction*> _blockTxns; // transactions picked for the next block
+    SeenFilter *_heardTxns; // transaction received so far (including those not in blockchain)
+    vector<uint64_t> _heardBlocks; // bitset over tree node indexes, blocks received so far (including orphans)
+    size_t _maxBlockTxns; // most transactions in a created block, 0 for no limit
+    int _blockPolicy; // SELECT_* rule for full blocks
+
+    // the top and own balance whole network scans read from the table
+    void publish_top() {
+        _table.top(_id) = _blockChain.top();
+        _table.balance(_id) = _ledger.balance(_id);
     }
 };
 
@@ -0,0 +1,80 @@
+#ifndef NODETABLE_H
+#define NODETABLE_H
+
+#include <vector>
+#include <stdint.h>
+#include "types.h"
+#include "rng.h"
+#include "blocknode.h"
+
+using namespace std;
+
+typedef unsigned int NodeType;
+const NodeType SLOW = 0;
+const NodeType FAST = 1;
+
+// the scalar state of every node, one array per field indexed by node id.
+// the creation handlers read and advance a node's stream, rates, creation
+// times and counts here, and whole network scans (digest, best top,
+// pruning, metrics) read the tops and balances without visiting the Node
+// objects, which keep the heavyweight containers: blockchain, mempool,
+// ledger and the heard filters. the partitions own contiguous id ranges,
+// so threads only share the cache lines at their boundaries
+class NodeTable {
+public:
+	// appends the row of the next node id; the top and balance are set by
+	// the node once its ledger is at the genesis block
+	Id add(NodeType type, double txnRate, double blockRate, uint64_t streamKey) {
+		_types.push_back(type);
+		_txnRates.push_back(txnRate);
+		_blockRates.push_back(blockRate);
+		_txnTimes.push_back(0);
+		_blockTimes.push_back(0);
+		_streams.push_back(Stream(streamKey));
+		_txnCounts.push_back(0);
+		_blockCounts.push_back(0);
+		_tops.push_back(NULL);
+		_balances.push_back(0);
+		return _types.size() - 1;
+	}
+
+	size_t nodes() const { return _types.size(); }
+
+	NodeType& type(Id node) { return _types[node]; }
+
+	// rates of the exponential transaction interarrival and block creation times
+	double& txn_rate(Id node) { return _txnRates[node]; }
+
+	double& block_rate(Id node) { return _blockRates[node]; }
+
+	// time of the node's next transaction and block
+	Time& txn_time(Id node) { return _txnTimes[node]; }
+
+	Time& block_time(Id node) { return _blockTimes[node]; }
+
+	Stream& stream(Id node) { return _streams[node]; }
+
+	// transactions and blocks the node created so far
+	unsigned long long& txn_count(Id node) { return _txnCounts[node]; }
+
+	unsigned long long& block_count(Id node) { return _blockCounts[node]; }
+
+	// top of the node's blockchain and its own balance there, kept by the node
+	BlockNode*& top(Id node) { return _tops[node]; }
+
+	Coin& balance(Id node) { return _balances[node]; }
+
+private:
+	vector<NodeType> _types;
+	vector<double> _txnRates;
+	vector<double> _blockRates;
+	vector<Time> _txnTimes;
+	vector<Time> _blockTimes;
+	vector<Stream> _streams;
+	vector<unsigned long long> _txnCounts;
+	vector<unsigned long long> _blockCounts;
+	vector<BlockNode*> _tops;
+	vector<Coin> _balances;
+};
+
+#endif // NODETABLE_H
@@ -0,0 +1,226 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <time.h>
+#include "trace.h"
+#include "mempool.h"
+
+using namespace std;
+
+// optional --key=value settings that follow the positional arguments
+class Options {
+public:
+	Options() : queue("dary"), logLevel(TRACE_EVENTS), traceColumns(false), traceAsync(false),
+		topology("dense"), degree(8), rewire(0.1), seed(time(NULL)), latency("floor"),
+		threads(1), until(numeric_limits<double>::infinity()), txnRate(1), blockRate(1),
+		blockSize(0), blockPolicy(SELECT_OLDEST), orphanLimit(0), orphanTtl(numeric_limits<double>::infinity()),
+		relay("flood"), relayInterval(0.1), relayBatch(32), blockRelay("full"), delivery("eager"), finality(0), pruneInterval(10),
+		seen("bitmap"), seenCapacity(20000), seenFpRate(0.000001),
+		exportFile("graphs/blocktree.dot"), metricsInterval(1), progressInterval(0) {}
+
+	string queue; // event scheduler: binary or dary
+	int logLevel; // TRACE_SILENT .. TRACE_EVENTS
+	string traceFile; // binary trace output, text on stdout if empty
+	bool traceColumns; // binary trace in column chunks instead of rows
+	bool traceAsync; // write trace chunks on a background thread
+	string topology; // peer graph generator: dense, er, regular, ba or ws
+	double degree; // target mean degree of the sparse topologies
+	double rewire; // rewiring probability of the ws topology
+	unsigned long long seed; // seed of the topology generator and all random streams
+	string latency; // floor: latencies in whole seconds, ms: in milliseconds, exact: unrounded
+	int threads; // worker threads, more than one selects the parallel engine
+	double until; // simulated time at which the run stops
+	double txnRate; // scales every node's transaction creation rate
+	double blockRate; // scales every node's block creation rate
+	size_t blockSize; // most transactions per created block, 0 for no limit
+	int blockPolicy; // SELECT_OLDEST or SELECT_LARGEST
+	size_t orphanLimit; // most orphan blocks a node holds, 0 for no limit
+	double orphanTtl; // simulated seconds an orphan waits for its parent
+	string relay; // transaction relay: flood or batch
+	double relayInterval; // batch relay: seconds between flushes of a node's buffers
+	size_t relayBatch; // batch relay: a link's buffer is sent once it holds this many
+	string blockRelay; // full or compact blocks
+	string delivery; // eager: one event per broadcast receiver, lazy: one per broadcast
+	unsigned long finality; // blocks below the tops after which a block is final and its history freed, 0 for never
+	double pruneInterval; // simulated seconds between prunings of the block tree
+	string seen; // filter of the transactions a node has heard: hash, bitmap or bloom
+	size_t seenCapacity; // bloom: ids remembered at least
+	double seenFpRate; // bloom: false positive rate
+	string savePath; // snapshot of the final state, none if empty
+	string exportFile; // block tree export at the end of the run, none if empty
+	string metricsFile; // JSON metrics of the run, none if empty
+	double metricsInterval; // simulated seconds between mempool samples
+	string profileFile; // JSON hot path profile, builds with -DP2P_PROFILE only
+	double progressInterval; // wall clock seconds between progress lines on stderr, 0 for none
+};
+
+// returns false on an unknown or malformed option
+bool parse_options(int argc, char **argv, int first, Options &options) {
+	for (int i = first; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+			cout << "malformed option " << arg << endl;
+			return false;
+		}
+		string key = arg.substr(2, eq - 2);
+		string value = arg.substr(eq + 1);
+		if (key == "queue") {
+			if (value != "binary" && value != "dary") {
+				cout << "unknown scheduler " << value << endl;
+				return false;
+			}
+			options.queue = value;
+		} else if (key == "log") {
+			const char *levels[] = {"silent", "summary", "events"};
+			options.logLevel = -1;
+			for (int level = TRACE_SILENT; level <= TRACE_EVENTS; level++) {
+				if (value == levels[level]) {
+					options.logLevel = level;
+				}
+			}
+			if (options.logLevel < 0) {
+				cout << "unknown log level " << value << endl;
+				return false;
+			}
+		} else if (key == "trace-file") {
+			options.traceFile = value;
+		} else if (key == "trace-format") {
+			if (value != "rows" && value != "columns") {
+				cout << "unknown trace format " << value << endl;
+				return false;
+			}
+			options.traceColumns = (value == "columns");
+		} else if (key == "trace-writer") {
+			if (value != "inline" && value != "thread") {
+				cout << "unknown trace writer " << value << endl;
+				return false;
+			}
+			options.traceAsync = (value == "thread");
+		} else if (key == "topology") {
+			const char *kinds[] = {"dense", "er", "regular", "ba", "ws"};
+			if (find(kinds, kinds + 5, value) == kinds + 5) {
+				cout << "unknown topology " << value << endl;
+				return false;
+			}
+			options.topology = value;
+		} else if (key == "degree") {
+			options.degree = stod(value);
+		} else if (key == "rewire") {
+			options.rewire = stod(value);
+		} else if (key == "seed") {
+			options.seed = stoull(value);
+		} else if (key == "latency") {
+			if (value != "floor" && value != "ms" && value != "exact") {
+				cout << "unknown latency rounding " << value << endl;
+				return false;
+			}
+			options.latency = value;
+		} else if (key == "threads") {
+			options.threads = stoi(value);
+		} else if (key == "until") {
+			options.until = stod(value);
+		} else if (key == "txn-rate") {
+			options.txnRate = stod(value);
+		} else if (key == "block-rate") {
+			options.blockRate = stod(value);
+		} else if (key == "block-size") {
+			options.blockSize = stoul(value);
+		} else if (key == "orphan-limit") {
+			options.orphanLimit = stoul(value);
+		} else if (key == "orphan-ttl") {
+			options.orphanTtl = stod(value);
+		} else if (key == "relay") {
+			if (value != "flood" && value != "batch") {
+				cout << "unknown relay mode " << value << endl;
+				return false;
+			}
+			options.relay = value;
+		} else if (key == "relay-interval") {
+			options.relayInterval = stod(value);
+			if (options.relayInterval <= 0) {
+				cout << "--relay-interval must be positive" << endl;
+				return false;
+			}
+		} else if (key == "relay-batch") {
+			options.relayBatch = max(1UL, stoul(value));
+		} else if (key == "block-relay") {
+			if (value != "full" && value != "compact") {
+				cout << "unknown block relay " << value << endl;
+				return false;
+			}
+			options.blockRelay = value;
+		} else if (key == "delivery") {
+			if (value != "eager" && value != "lazy") {
+				cout << "unknown delivery mode " << value << endl;
+				return false;
+			}
+			options.delivery = value;
+		} else if (key == "finality") {
+			options.finality = stoul(value);
+		} else if (key == "prune-interval") {
+			options.pruneInterval = stod(value);
+			if (options.pruneInterval <= 0) {
+				cout << "--prune-interval must be positive" << endl;
+				return false;
+			}
+		} else if (key == "seen") {
+			if (value != "hash" && value != "bitmap" && value != "bloom") {
+				cout << "unknown seen filter " << value << endl;
+				return false;
+			}
+			options.seen = value;
+		} else if (key == "seen-capacity") {
+			options.seenCapacity = max(2UL, stoul(value));
+		} else if (key == "seen-fp") {
+			options.seenFpRate = stod(value);
+			if (options.seenFpRate <= 0 || options.seenFpRate >= 1) {
+				cout << "--seen-fp must be between 0 and 1" << endl;
+				return false;
+			}
+		} else if (key == "metrics") {
+			options.metricsFile = value;
+		} else if (key == "metrics-interval") {
+			options.metricsInterval = stod(value);
+			if (options.metricsInterval <= 0) {
+				cout << "--metrics-interval must be positive" << endl;
+				return false;
+			}
+		} else if (key == "profile" || key == "progress") {
+#ifndef P2P_PROFILE
+			cout << "--" << key << " needs a build with -DP2P_PROFILE (make instrumented)" << endl;
+			return false;
+#endif
+			if (key == "profile") {
+				options.profileFile = value;
+			} else {
+				options.progressInterval = stod(value);
+			}
+		} else if (key == "export") {
+			options.exportFile = value;
+		} else if (key == "save") {
+			options.savePath = value;
+		} else if (key == "block-policy") {
+			options.blockPolicy = block_policy(value);
+			if (options.blockPolicy < 0) {
+				cout << "unknown block policy " << value << endl;
+				return false;
+			}
+		} else {
+			cout << "unknown option " << arg << endl;
+			return false;
+		}
+	}
+	// rounded latencies can be zero, which leaves the parallel engine no lookahead
+	if (options.threads > 1 && options.latency == "floor") {
+		cout << "--threads needs --latency=ms or --latency=exact" << endl;
+		return false;
+	}
+	return true;
+}
+
+#endif // OPTIONS_H
@@ -0,0 +1,90 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "event.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "metrics.h"
+#include "profile.h"
+
+using namespace std;
+
+// reusable barrier for a fixed number of threads
+class Barrier {
+public:
+	Barrier(size_t count) : _count(count), _waiting(0), _generation(0) {}
+
+	void wait() {
+		unique_lock<mutex> lock(_mutex);
+		unsigned long generation = _generation;
+		if (++_waiting == _count) {
+			_waiting = 0;
+			_generation++;
+			_released.notify_all();
+		} else {
+			_released.wait(lock, [this, generation] { return generation != _generation; });
+		}
+	}
+
+private:
+	size_t _count;
+	size_t _waiting;
+	unsigned long _generation;
+	mutex _mutex;
+	condition_variable _released;
+};
+
+// event on its way to another partition along with its tie breaking key
+struct Message {
+	Event event;
+	uint64_t key;
+};
+
+// the nodes simulated by one worker thread, with their own event queue.
+// outbox[p] collects events for nodes of partition p during a window. it is
+// only written by this partition's thread while the window runs and only read
+// and cleared by partition p's thread after the window barrier, so it needs no
+// lock.
+class Partition {
+public:
+	Partition(size_t index, size_t partitions, EventQueue *queue) :
+		index(index), queue(queue), outbox(partitions) {}
+
+	~Partition() {
+		delete queue;
+		for (Fanout *fanout : fanouts) {
+			delete fanout;
+		}
+	}
+
+	// an empty broadcast record, recycled ones first
+	Fanout* new_fanout() {
+		if (spareFanouts.empty()) {
+			fanouts.push_back(new Fanout());
+			spareFanouts.push_back(fanouts.back());
+		}
+		Fanout *fanout = spareFanouts.back();
+		spareFanouts.pop_back();
+		fanout->deliveries.clear();
+		fanout->next = 0;
+		return fanout;
+	}
+
+	void release_fanout(Fanout *fanout) { spareFanouts.push_back(fanout); }
+
+	size_t index;
+	EventQueue *queue;
+	vector<vector<Message> > outbox;
+	RunStats stats;
+	Metrics metrics; // only updated when metrics are enabled
+	vector<Time> latencies; // scratch for the latencies of one broadcast
+	vector<Fanout*> fanouts; // lazy delivery: every broadcast record of the partition
+	vector<Fanout*> spareFanouts; // of those, the ones not in use
+	PROFILE(Profile profile;)
+};
+
+#endif // PARALLEL_H
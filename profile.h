@@ -0,0 +1,78 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "types.h"
+#include "metrics.h"
+
+using namespace std;
+
+// hot path instrumentation, compiled in with -DP2P_PROFILE (make instrumented).
+// without it every PROFILE(...) statement disappears and the simulator pays
+// nothing for it
+#ifdef P2P_PROFILE
+#define PROFILE(...) __VA_ARGS__
+#else
+#define PROFILE(...)
+#endif
+
+const int EVENT_TYPES = 7; // CREATE_TRANSACTION .. RECEIVE_BLOCK_TXNS
+const char* const EVENT_NAMES[EVENT_TYPES] = {"create_transaction", "create_block", "receive_transaction",
+	"receive_block", "relay_flush", "receive_inventory", "receive_block_txns"};
+const unsigned long long PROFILE_SAMPLE_EVENTS = 1 << 14; // events between queue size samples
+
+// time stamp counter, or steady clock nanoseconds where there is none
+inline uint64_t cycle_count() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// where one partition spent its time and memory. nodes are only touched by
+// the partition that owns them, so the per node counts need no lock
+struct Profile {
+	unsigned long long events[EVENT_TYPES];
+	unsigned long long cycles[EVENT_TYPES]; // spent in the handler of each event type
+	unsigned long long popCycles; // spent taking events off the queue
+	Histogram queueSize; // pending events, sampled every event
+	vector<pair<Time,size_t> > queueSamples; // simulated time and queue size every PROFILE_SAMPLE_EVENTS events
+	unsigned long long txnBytes; // transactions created
+	unsigned long long blockBytes; // blocks created with their tree nodes and transaction lists
+	unsigned long long inventoryBytes; // batched relay transaction lists
+	vector<unsigned long long> fanout; // messages sent by each node
+
+	Profile() : popCycles(0), queueSize(1), txnBytes(0), blockBytes(0), inventoryBytes(0) {
+		for (int t = 0; t < EVENT_TYPES; t++) {
+			events[t] = 0;
+			cycles[t] = 0;
+		}
+	}
+
+	void merge(const Profile &other) {
+		for (int t = 0; t < EVENT_TYPES; t++) {
+			events[t] += other.events[t];
+			cycles[t] += other.cycles[t];
+		}
+		popCycles += other.popCycles;
+		queueSize.merge(other.queueSize);
+		txnBytes += other.txnBytes;
+		blockBytes += other.blockBytes;
+		inventoryBytes += other.inventoryBytes;
+		if (fanout.size() < other.fanout.size()) {
+			fanout.resize(other.fanout.size(), 0);
+		}
+		for (size_t i = 0; i < other.fanout.size(); i++) {
+			fanout[i] += other.fanout[i];
+		}
+	}
+};
+
+#endif // PROFILE_H
@@ -0,0 +1,67 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cmath>
+#include <stdint.h>
+
+// stream domains, every node, link and setup step draws from its own stream
+const uint64_t NETWORK_STREAM = 1; // node rates and link attributes
+const uint64_t TOPOLOGY_STREAM = 2;
+const uint64_t NODE_STREAM = 3; // creation times, payees and amounts of a node
+const uint64_t LINK_STREAM = 4; // latencies of messages on one directed edge
+const uint64_t FILTER_STREAM = 5; // salt of a node's seen filter hashes
+
+const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+// SplitMix64 output function, a bijective avalanche mix of 64 bits
+inline uint64_t mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// key of the index-th stream of a domain under the master seed
+inline uint64_t stream_key(uint64_t seed, uint64_t domain, uint64_t index) {
+	return mix64(mix64(seed + domain * GOLDEN_GAMMA) ^ mix64(index + GOLDEN_GAMMA));
+}
+
+// counter based random stream: draw i is mix64(key + i * gamma). the whole
+// state is two words, streams with different keys do not interact and
+// nothing is shared between threads. usable as a standard uniform random bit
+// generator.
+class Stream {
+public:
+	typedef uint64_t result_type;
+
+	Stream() : _key(0), _counter(0) {}
+
+	Stream(uint64_t key) : _key(key), _counter(0) {}
+
+	// resumes a stream after counter draws
+	Stream(uint64_t key, uint64_t counter) : _key(key), _counter(counter) {}
+
+	static constexpr uint64_t min() { return 0; }
+
+	static constexpr uint64_t max() { return ~0ULL; }
+
+	uint64_t operator() () { return mix64(_key + ++_counter * GOLDEN_GAMMA); }
+
+	// uniform in (0, 1]
+	double uniform() { return ((*this)() >> 11) * (1.0 / 9007199254740992.0) + (1.0 / 9007199254740992.0); }
+
+	// exponential with the given rate, inverse transform of uniform()
+	double exponential(double rate) { return -std::log(uniform()) / rate; }
+
+	// uniform in [0, n)
+	uint64_t below(uint64_t n) { return (uint64_t) (((unsigned __int128) (*this)() * n) >> 64); }
+
+	uint64_t key() const { return _key; }
+
+	uint64_t counter() const { return _counter; }
+
+private:
+	uint64_t _key;
+	uint64_t _counter; // draws taken so far
+};
+
+#endif // RNG_H
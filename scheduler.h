@@ -0,0 +1,382 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <stdint.h>
+#include "event.h"
+
+using namespace std;
+
+// slab of event records, a slot is recycled as soon as its event is dispatched
+// or canceled. the generation of a slot changes on every release so that a
+// handle to an event that already left the queue can be detected.
+class EventPool {
+public:
+	uint32_t alloc(const Event &event) {
+		uint32_t slot;
+		if (_free.empty()) {
+			slot = _events.size();
+			_events.push_back(event);
+			_gens.push_back(0);
+			_positions.push_back(0);
+		} else {
+			slot = _free.back();
+			_free.pop_back();
+			_events[slot] = event;
+		}
+		return slot;
+	}
+
+	void release(uint32_t slot) {
+		_gens[slot]++;
+		_free.push_back(slot);
+	}
+
+	const Event& get(uint32_t slot) const { return _events[slot]; }
+
+	Event& get(uint32_t slot) { return _events[slot]; }
+
+	uint32_t gen(uint32_t slot) const { return _gens[slot]; }
+
+	// index of the slot's entry in an indexed heap
+	uint32_t& position(uint32_t slot) { return _positions[slot]; }
+
+	size_t capacity() const { return _events.size(); }
+
+private:
+	vector<Event> _events;
+	vector<uint32_t> _gens;
+	vector<uint32_t> _positions;
+	vector<uint32_t> _free; // recycled slots
+};
+
+// refers to a pending event, stays valid until the event is popped or canceled
+struct EventHandle {
+	uint32_t slot;
+	uint32_t gen;
+};
+
+const EventHandle NO_EVENT = {0xffffffff, 0};
+
+// heap entry, keeps the ordering key next to the slot so sifting never touches the slab
+struct QueueEntry {
+	Time time;
+	uint64_t key; // breaks ties between simultaneous events
+	uint32_t slot;
+	uint32_t gen; // generation of the slot when the entry was pushed
+};
+
+inline bool earlier(const QueueEntry &lhs, const QueueEntry &rhs) {
+	return lhs.time < rhs.time || (lhs.time == rhs.time && lhs.key < rhs.key);
+}
+
+class EventQueue {
+public:
+	EventQueue() : _staleAvoided(0), _stalePopped(0) {}
+
+	virtual ~EventQueue() {}
+
+	// key orders events with the same time, lowest first
+	EventHandle push(const Event &event, uint64_t key) {
+		QueueEntry entry = make_entry(event.time, key, _pool.alloc(event));
+		push_entry(entry);
+		EventHandle handle = {entry.slot, entry.gen};
+		return handle;
+	}
+
+	// copies the earliest event into event and recycles its slot
+	bool pop(Event &event) {
+		QueueEntry entry;
+		if (!pop_entry(entry)) {
+			return false;
+		}
+		event = _pool.get(entry.slot);
+		_pool.release(entry.slot);
+		return true;
+	}
+
+	// time of the earliest event, returns false if the queue is empty
+	bool next_time(Time &time) {
+		QueueEntry entry;
+		if (!peek_entry(entry)) {
+			return false;
+		}
+		time = entry.time;
+		return true;
+	}
+
+	// true if the event has neither been popped nor canceled
+	bool pending(const EventHandle &handle) const {
+		return handle.slot < _pool.capacity() && _pool.gen(handle.slot) == handle.gen;
+	}
+
+	// moves a pending event to a new time and tie breaking key. handle is
+	// updated to refer to the moved event.
+	// returns false if the event is no longer pending
+	bool reschedule(EventHandle &handle, Time time, uint64_t key) {
+		if (!pending(handle)) {
+			return false;
+		}
+		_pool.get(handle.slot).time = time;
+		reschedule_entry(handle, time, key);
+		return true;
+	}
+
+	// removes a pending event, returns false if it is no longer pending.
+	// the network only reschedules, this completes the queue interface
+	bool cancel(EventHandle &handle) {
+		if (!pending(handle)) {
+			return false;
+		}
+		cancel_entry(handle.slot);
+		_pool.release(handle.slot);
+		handle = NO_EVENT;
+		return true;
+	}
+
+	// copies every pending event and its key, in no particular order
+	void pending_events(vector<Event> &events, vector<uint64_t> &keys) const {
+		vector<QueueEntry> entries;
+		live_entries(entries);
+		for (const QueueEntry &entry : entries) {
+			events.push_back(_pool.get(entry.slot));
+			keys.push_back(entry.key);
+		}
+	}
+
+	virtual bool empty() const = 0;
+
+	virtual size_t size() const = 0;
+
+	virtual const char* name() const = 0;
+
+	// event records allocated so far, pending or recycled
+	size_t capacity() const { return _pool.capacity(); }
+
+	// reschedules and cancels which did not leave a dead entry behind
+	unsigned long long stale_avoided() const { return _staleAvoided; }
+
+	// dead entries which had to be popped and thrown away
+	unsigned long long stale_popped() const { return _stalePopped; }
+
+protected:
+	EventPool _pool;
+	unsigned long long _staleAvoided;
+	unsigned long long _stalePopped;
+
+	QueueEntry make_entry(Time time, uint64_t key, uint32_t slot) {
+		QueueEntry entry;
+		entry.time = time;
+		entry.key = key;
+		entry.slot = slot;
+		entry.gen = _pool.gen(slot);
+		return entry;
+	}
+
+	virtual void push_entry(const QueueEntry &entry) = 0;
+
+	virtual bool pop_entry(QueueEntry &entry) = 0;
+
+	virtual bool peek_entry(QueueEntry &entry) = 0;
+
+	virtual void reschedule_entry(EventHandle &handle, Time time, uint64_t key) = 0;
+
+	// called before the slot is released
+	virtual void cancel_entry(uint32_t slot) = 0;
+
+	// the entries of pending events
+	virtual void live_entries(vector<QueueEntry> &entries) const = 0;
+};
+
+// std::priority_queue, the scheduler the simulator used originally. it can not
+// move an entry, so a rescheduled or canceled event leaves a dead entry behind
+// which is skipped when it reaches the top.
+class BinaryHeapQueue : public EventQueue {
+public:
+	BinaryHeapQueue() : _dead(0) {}
+
+	bool empty() const { return _heap.size() == _dead; }
+
+	size_t size() const { return _heap.size() - _dead; }
+
+	const char* name() const { return "binary"; }
+
+protected:
+	void push_entry(const QueueEntry &entry) { _heap.push(entry); }
+
+	bool pop_entry(QueueEntry &entry) {
+		if (!peek_entry(entry)) {
+			return false;
+		}
+		_heap.pop();
+		return true;
+	}
+
+	bool peek_entry(QueueEntry &entry) {
+		while (!_heap.empty()) {
+			entry = _heap.top();
+			if (entry.gen == _pool.gen(entry.slot)) {
+				return true;
+			}
+			_heap.pop();
+			_dead--;
+			_stalePopped++;
+		}
+		return false;
+	}
+
+	void reschedule_entry(EventHandle &handle, Time /* time */, uint64_t key) {
+		Event event = _pool.get(handle.slot);
+		_pool.release(handle.slot);
+		_dead++;
+		handle = push(event, key);
+	}
+
+	void cancel_entry(uint32_t /* slot */) {
+		_dead++;
+	}
+
+	void live_entries(vector<QueueEntry> &entries) const {
+		priority_queue<QueueEntry, vector<QueueEntry>, Later> heap(_heap);
+		for (; !heap.empty(); heap.pop()) {
+			if (heap.top().gen == _pool.gen(heap.top().slot)) {
+				entries.push_back(heap.top());
+			}
+		}
+	}
+
+private:
+	class Later {
+	public:
+		bool operator() (const QueueEntry &lhs, const QueueEntry &rhs) const {
+			return earlier(rhs, lhs);
+		}
+	};
+
+	priority_queue<QueueEntry, vector<QueueEntry>, Later> _heap;
+	size_t _dead; // entries of rescheduled or canceled events
+};
+
+// implicit D-ary min-heap, shallower than a binary heap and the children of
+// a node share a cache line. the pool records where each slot sits in the
+// heap so rescheduling is an in-place O(log n) sift and canceling removes the
+// entry outright.
+template <int D>
+class DaryHeapQueue : public EventQueue {
+public:
+	bool empty() const { return _heap.empty(); }
+
+	size_t size() const { return _heap.size(); }
+
+	const char* name() const { return "dary"; }
+
+protected:
+	void push_entry(const QueueEntry &entry) {
+		_heap.push_back(entry);
+		sift_up(_heap.size() - 1);
+	}
+
+	bool pop_entry(QueueEntry &entry) {
+		if (_heap.empty()) {
+			return false;
+		}
+		entry = _heap[0];
+		remove_at(0);
+		return true;
+	}
+
+	bool peek_entry(QueueEntry &entry) {
+		if (_heap.empty()) {
+			return false;
+		}
+		entry = _heap[0];
+		return true;
+	}
+
+	void reschedule_entry(EventHandle &handle, Time time, uint64_t key) {
+		size_t i = _pool.position(handle.slot);
+		_heap[i].time = time;
+		_heap[i].key = key;
+		_staleAvoided++;
+		sift_up(i);
+		sift_down(_pool.position(handle.slot));
+	}
+
+	void cancel_entry(uint32_t slot) {
+		_staleAvoided++;
+		remove_at(_pool.position(slot));
+	}
+
+	void live_entries(vector<QueueEntry> &entries) const {
+		entries.insert(entries.end(), _heap.begin(), _heap.end());
+	}
+
+private:
+	vector<QueueEntry> _heap;
+
+	void place(size_t i, const QueueEntry &entry) {
+		_heap[i] = entry;
+		_pool.position(entry.slot) = i;
+	}
+
+	void remove_at(size_t i) {
+		QueueEntry last = _heap.back();
+		_heap.pop_back();
+		if (i < _heap.size()) {
+			place(i, last);
+			sift_up(i);
+			sift_down(_pool.position(last.slot));
+		}
+	}
+
+	void sift_up(size_t i) {
+		QueueEntry entry = _heap[i];
+		while (i > 0) {
+			size_t parent = (i - 1) / D;
+			if (!earlier(entry, _heap[parent])) {
+				break;
+			}
+			place(i, _heap[parent]);
+			i = parent;
+		}
+		place(i, entry);
+	}
+
+	void sift_down(size_t i) {
+		QueueEntry entry = _heap[i];
+		size_t n = _heap.size();
+		while (true) {
+			size_t first = i * D + 1;
+			if (first >= n) {
+				break;
+			}
+			size_t last = first + D < n ? first + D : n;
+			size_t best = first;
+			for (size_t c = first + 1; c < last; c++) {
+				if (earlier(_heap[c], _heap[best])) {
+					best = c;
+				}
+			}
+			if (!earlier(_heap[best], entry)) {
+				break;
+			}
+			place(i, _heap[best]);
+			i = best;
+		}
+		place(i, entry);
+	}
+};
+
+// returns NULL if kind is not a known scheduler
+inline EventQueue* make_event_queue(const string &kind) {
+	if (kind == "binary") {
+		return new BinaryHeapQueue();
+	} else if (kind == "dary") {
+		return new DaryHeapQueue<4>();
+	}
+	return NULL;
+}
+
+#endif // SCHEDULER_H
@@ -0,0 +1,275 @@
+#ifndef SEENFILTER_H
+#define SEENFILTER_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <unordered_set>
+#include <stdint.h>
+#include "types.h"
+#include "rng.h"
+#include "snapshot.h"
+
+using namespace std;
+
+const uint8_t SEEN_HASH = 0;
+const uint8_t SEEN_BITMAP = 1;
+const uint8_t SEEN_BLOOM = 2;
+
+// the ids of the transactions a node has heard, which it drops when they
+// arrive again. looked up on every received transaction, inventory entry and
+// compact block transaction
+class SeenFilter {
+public:
+	virtual ~SeenFilter() {}
+
+	// true if id was inserted. an approximate filter may also say so for an
+	// id it never saw, and forget old ones
+	virtual bool contains(Id id) const = 0;
+
+	virtual void insert(Id id) = 0;
+
+	// id can not arrive again, a filter may free it
+	virtual void forget(Id /* id */) {}
+
+	// memory held, estimated for the hash set
+	virtual size_t bytes() const = 0;
+
+	virtual const char* name() const = 0;
+
+	virtual uint8_t kind() const = 0;
+
+	// the kind is written by save_seen_filter, the settings and contents here
+	virtual void save(SnapshotWriter &out) const = 0;
+
+	virtual void load(SnapshotReader &in) = 0;
+};
+
+// exact, one hash set entry per id
+class HashSeenFilter : public SeenFilter {
+public:
+	bool contains(Id id) const { return _ids.count(id); }
+
+	void insert(Id id) { _ids.insert(id); }
+
+	void forget(Id id) { _ids.erase(id); }
+
+	// a node holds the id and the next pointer, plus the allocator's header
+	size_t bytes() const { return _ids.bucket_count() * sizeof(void*) + _ids.size() * (sizeof(Id) + 3 * sizeof(void*)); }
+
+	const char* name() const { return "hash"; }
+
+	uint8_t kind() const { return SEEN_HASH; }
+
+	void save(SnapshotWriter &out) const { out.put_vector(vector<Id>(_ids.begin(), _ids.end())); }
+
+	void load(SnapshotReader &in) {
+		vector<Id> ids;
+		in.get_vector(ids);
+		_ids.clear();
+		_ids.insert(ids.begin(), ids.end());
+	}
+
+private:
+	unordered_set<Id> _ids;
+};
+
+// exact, one bit per id above a base below which every id has been heard.
+// creator scoped ids of all nodes interleave, so the bits span from the
+// oldest transaction of the slowest creator not heard yet to the newest
+// heard one. full words at the front are dropped once they make up half
+// of the bitmap
+class BitmapSeenFilter : public SeenFilter {
+public:
+	BitmapSeenFilter() : _base(0), _full(0) {}
+
+	bool contains(Id id) const {
+		if (id < _base) {
+			return true;
+		}
+		Id bit = id - _base;
+		return bit / 64 < _words.size() && (_words[bit / 64] >> (bit % 64) & 1);
+	}
+
+	void insert(Id id) {
+		if (id < _base) {
+			return;
+		}
+		Id bit = id - _base;
+		size_t w = bit / 64;
+		if (w >= _words.size()) {
+			_words.resize(w + 1, 0);
+		}
+		_words[w] |= 1ULL << (bit % 64);
+		if (w != _full || _words[w] != ~0ULL) {
+			return;
+		}
+		while (_full < _words.size() && _words[_full] == ~0ULL) {
+			_full++;
+		}
+		if (_full * 2 >= _words.size()) {
+			_words.erase(_words.begin(), _words.begin() + _full);
+			_base += _full * 64;
+			_full = 0;
+		}
+	}
+
+	size_t bytes() const { return _words.capacity() * sizeof(uint64_t); }
+
+	const char* name() const { return "bitmap"; }
+
+	uint8_t kind() const { return SEEN_BITMAP; }
+
+	void save(SnapshotWriter &out) const {
+		out.put(_base);
+		out.put((uint64_t) _full);
+		out.put_vector(_words);
+	}
+
+	void load(SnapshotReader &in) {
+		_base = in.get<Id>();
+		_full = in.get<uint64_t>();
+		in.get_vector(_words);
+		if (_full > _words.size()) {
+			in.fail("bad seen filter");
+		}
+	}
+
+private:
+	Id _base; // first id of _words[0], a multiple of 64
+	size_t _full; // leading words with every bit set
+	vector<uint64_t> _words;
+};
+
+// approximate, remembers the latest capacity / 2 to capacity ids in two
+// Bloom filters of capacity / 2 ids each: once the current one is full the
+// other one is cleared and takes its place. a lookup checks both, so each is
+// sized for half the false positive rate. a false positive drops a
+// transaction the node never had, an id older than the window is taken as
+// new. the bit positions are salted per node, so nodes do not share their
+// false positives
+class BloomSeenFilter : public SeenFilter {
+public:
+	BloomSeenFilter(size_t capacity, double fpRate, uint64_t salt) { configure(capacity, fpRate, salt); }
+
+	bool contains(Id id) const {
+		uint64_t h1 = mix64(id ^ _salt), h2 = mix64(h1) | 1;
+		return test(_filters[_current], h1, h2) || test(_filters[_current ^ 1], h1, h2);
+	}
+
+	void insert(Id id) {
+		if (_count == _capacity / 2) {
+			_current ^= 1;
+			fill(_filters[_current].begin(), _filters[_current].end(), 0);
+			_count = 0;
+		}
+		uint64_t h1 = mix64(id ^ _salt), h2 = mix64(h1) | 1;
+		vector<uint64_t> &bits = _filters[_current];
+		for (int i = 0; i < _hashes; i++) {
+			uint64_t bit = position(h1 + i * h2);
+			bits[bit / 64] |= 1ULL << (bit % 64);
+		}
+		_count++;
+	}
+
+	size_t bytes() const { return (_filters[0].capacity() + _filters[1].capacity()) * sizeof(uint64_t); }
+
+	const char* name() const { return "bloom"; }
+
+	uint8_t kind() const { return SEEN_BLOOM; }
+
+	void save(SnapshotWriter &out) const {
+		out.put((uint64_t) _capacity);
+		out.put(_fpRate);
+		out.put(_salt);
+		out.put((uint64_t) _current);
+		out.put((uint64_t) _count);
+		out.put_vector(_filters[0]);
+		out.put_vector(_filters[1]);
+	}
+
+	void load(SnapshotReader &in) {
+		size_t capacity = in.get<uint64_t>();
+		double fpRate = in.get<double>();
+		uint64_t salt = in.get<uint64_t>();
+		configure(capacity, fpRate, salt);
+		_current = in.get<uint64_t>();
+		_count = in.get<uint64_t>();
+		in.get_vector(_filters[0]);
+		in.get_vector(_filters[1]);
+		if (_current > 1 || _count > _capacity / 2 || _filters[0].size() != _bits / 64 || _filters[1].size() != _bits / 64) {
+			in.fail("bad seen filter");
+		}
+	}
+
+private:
+	size_t _capacity; // ids remembered at least, at most twice as many
+	double _fpRate;
+	uint64_t _salt;
+	int _hashes; // bits set per id
+	uint64_t _bits; // per filter, a multiple of 64
+	vector<uint64_t> _filters[2];
+	size_t _current; // filter taking the inserts
+	size_t _count; // ids inserted into the current filter
+
+	// m = -n ln p / ln^2 2 bits and k = m / n ln 2 hashes for n ids at rate p
+	void configure(size_t capacity, double fpRate, uint64_t salt) {
+		_capacity = max((size_t) 2, capacity);
+		_fpRate = fpRate;
+		_salt = salt;
+		double n = _capacity / 2, p = fpRate / 2;
+		_bits = max((uint64_t) 64, ((uint64_t) ceil(-n * log(p) / (log(2) * log(2))) + 63) / 64 * 64);
+		_hashes = max(1, (int) round(_bits / n * log(2)));
+		_filters[0].assign(_bits / 64, 0);
+		_filters[1].assign(_bits / 64, 0);
+		_current = 0;
+		_count = 0;
+	}
+
+	// maps a hash onto [0, _bits) by its high bits, without a division
+	uint64_t position(uint64_t hash) const { return (uint64_t) (((unsigned __int128) hash * _bits) >> 64); }
+
+	// double hashing, the i-th bit is h1 + i h2
+	bool test(const vector<uint64_t> &bits, uint64_t h1, uint64_t h2) const {
+		for (int i = 0; i < _hashes; i++) {
+			uint64_t bit = position(h1 + i * h2);
+			if (!(bits[bit / 64] >> (bit % 64) & 1)) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// returns NULL if kind is not a known filter. capacity and fpRate only
+// apply to bloom, salt picks a node's bit positions
+inline SeenFilter* make_seen_filter(const string &kind, size_t capacity, double fpRate, uint64_t salt) {
+	if (kind == "hash") {
+		return new HashSeenFilter();
+	} else if (kind == "bitmap") {
+		return new BitmapSeenFilter();
+	} else if (kind == "bloom") {
+		return new BloomSeenFilter(capacity, fpRate, salt);
+	}
+	return NULL;
+}
+
+inline void save_seen_filter(SnapshotWriter &out, const SeenFilter &filter) {
+	out.put(filter.kind());
+	filter.save(out);
+}
+
+// a filter of the saved kind with the saved contents, NULL on a bad kind
+inline SeenFilter* load_seen_filter(SnapshotReader &in) {
+	uint8_t kind = in.get<uint8_t>();
+	const char *kinds[] = {"hash", "bitmap", "bloom"};
+	if (kind > SEEN_BLOOM) {
+		in.fail("bad seen filter");
+		return NULL;
+	}
+	SeenFilter *filter = make_seen_filter(kinds[kind], 2, 0.5, 0);
+	filter->load(in);
+	return filter;
+}
+
+#endif // SEENFILTER_H
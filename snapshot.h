@@ -0,0 +1,253 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "transaction.h"
+#include "blocknode.h"
+#include "store.h"
+
+using namespace std;
+
+const char SNAPSHOT_MAGIC[8] = {'P', '2', 'P', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 4;
+
+// header of a snapshot file, the sections follow in the order Network::save
+// writes them
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t nodes;
+};
+
+// writes a snapshot as native binary values. a transaction is written in
+// full where it is first referred to and as its serial number afterwards, a
+// block as its tree node index
+class SnapshotWriter {
+public:
+	SnapshotWriter() : _out(NULL) {}
+
+	~SnapshotWriter() { close(); }
+
+	bool open(const string &path, uint32_t nodes) {
+		_out = fopen(path.c_str(), "wb");
+		if (_out == NULL) {
+			return false;
+		}
+		setvbuf(_out, NULL, _IOFBF, 1 << 20);
+		SnapshotHeader header;
+		memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+		header.version = SNAPSHOT_VERSION;
+		header.nodes = nodes;
+		put(header);
+		return true;
+	}
+
+	// returns false if a write failed
+	bool close() {
+		if (_out == NULL) {
+			return true;
+		}
+		bool ok = !ferror(_out);
+		ok = fclose(_out) == 0 && ok;
+		_out = NULL;
+		return ok;
+	}
+
+	template <typename T>
+	void put(const T &value) { fwrite(&value, sizeof(T), 1, _out); }
+
+	// element count followed by the elements
+	template <typename T>
+	void put_vector(const vector<T> &values) {
+		put((uint64_t) values.size());
+		if (!values.empty()) {
+			fwrite(&values[0], sizeof(T), values.size(), _out);
+		}
+	}
+
+	void put_txn(const Transaction *txn) {
+		unordered_map<const Transaction*,uint32_t>::iterator it = _txnSerials.find(txn);
+		if (it != _txnSerials.end()) {
+			put(it->second);
+			return;
+		}
+		uint32_t serial = _txnSerials.size();
+		_txnSerials[txn] = serial;
+		put(serial);
+		put(txn->id());
+		put(txn->payer());
+		put(txn->payee());
+		put(txn->amount());
+		put(txn->created());
+	}
+
+	void put_txns(const vector<const Transaction*> &txns) {
+		put((uint64_t) txns.size());
+		for (const Transaction *txn : txns) {
+			put_txn(txn);
+		}
+	}
+
+	void put_block(const BlockNode *block) { put(block->index()); }
+
+private:
+	FILE *_out;
+	unordered_map<const Transaction*,uint32_t> _txnSerials;
+};
+
+// reads a snapshot mapped into memory. objects are recreated in shard 0 of
+// the attached store, blocks in index order so every index stays the same.
+// a malformed file sets an error and makes the remaining reads return
+// zeros, the genesis block and a placeholder transaction, so a loader can
+// run to the end of a section and check ok() afterwards.
+class SnapshotReader {
+public:
+	SnapshotReader() : _data(NULL), _size(0), _pos(0), _store(NULL), _placeholder(0, 0, 0, 0) {
+		memset(&_header, 0, sizeof(_header));
+	}
+
+	~SnapshotReader() {
+		if (_data != NULL) {
+			munmap((void*) _data, _size);
+		}
+	}
+
+	bool open(const string &path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return fail("can not open " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SnapshotHeader)) {
+			::close(fd);
+			return fail(path + " is not a snapshot");
+		}
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) {
+			return fail("can not map " + path);
+		}
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+		_data = (const char*) data;
+		_size = st.st_size;
+		_header = get<SnapshotHeader>();
+		if (memcmp(_header.magic, SNAPSHOT_MAGIC, sizeof(_header.magic)) != 0) {
+			return fail(path + " is not a snapshot");
+		}
+		if (_header.version != SNAPSHOT_VERSION) {
+			return fail(path + " has unsupported snapshot version " + to_string(_header.version));
+		}
+		return true;
+	}
+
+	bool ok() const { return _error.empty(); }
+
+	const string& error() const { return _error; }
+
+	// bytes not read yet
+	size_t remaining() const { return _size - _pos; }
+
+	// nodes of the saved network
+	size_t nodes() const { return _header.nodes; }
+
+	// store that receives the transactions and blocks
+	void attach(ObjectStore &store) { _store = &store; }
+
+	template <typename T>
+	T get() {
+		T value;
+		if (!take(&value, sizeof(T))) {
+			memset(&value, 0, sizeof(T));
+		}
+		return value;
+	}
+
+	template <typename T>
+	void get_vector(vector<T> &values) {
+		uint64_t count = get<uint64_t>();
+		if (count > (_size - _pos) / sizeof(T)) {
+			fail("truncated snapshot");
+			count = 0;
+		}
+		values.resize(count);
+		if (count > 0) {
+			take(&values[0], count * sizeof(T));
+		}
+	}
+
+	const Transaction* get_txn() {
+		uint32_t serial = get<uint32_t>();
+		if (serial < _txns.size()) {
+			return _txns[serial];
+		} else if (serial > _txns.size() || !ok()) {
+			fail("bad transaction reference");
+			return &_placeholder;
+		}
+		Id id = get<Id>();
+		Id payer = get<Id>();
+		Id payee = get<Id>();
+		Coin amount = get<Coin>();
+		Time created = get<Time>();
+		_txns.push_back(_store->shard(0).txns.create(id, payer, payee, amount, created));
+		return _txns.back();
+	}
+
+	void get_txns(vector<const Transaction*> &txns) {
+		uint64_t count = get<uint64_t>();
+		if (count > _size - _pos) {
+			fail("truncated snapshot");
+			count = 0;
+		}
+		txns.clear();
+		for (uint64_t i = 0; i < count; i++) {
+			txns.push_back(get_txn());
+		}
+	}
+
+	BlockNode* get_block() {
+		uint32_t index = get<uint32_t>();
+		if (index >= _store->blocks()) {
+			fail("bad block reference");
+			return _store->genesis();
+		}
+		return _store->block_node(index);
+	}
+
+	bool fail(const string &error) {
+		if (_error.empty()) {
+			_error = error;
+		}
+		return false;
+	}
+
+private:
+	const char *_data;
+	size_t _size;
+	size_t _pos;
+	SnapshotHeader _header;
+	string _error;
+	ObjectStore *_store;
+	vector<const Transaction*> _txns; // by serial
+	Transaction _placeholder;
+
+	bool take(void *to, size_t bytes) {
+		if (!ok() || bytes > _size - _pos) {
+			return fail("truncated snapshot");
+		}
+		memcpy(to, _data + _pos, bytes);
+		_pos += bytes;
+		return true;
+	}
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <vector>
+#include "types.h"
+
+using namespace std;
+
+// totals of a simulation run, summed over partitions
+struct RunStats {
+	unsigned long long events;
+	unsigned long long ctc; // number of create transaction events
+	unsigned long long cbc; // number of create block events
+	unsigned long long rtc; // number of receive transaction events
+	unsigned long long rbc; // number of receive block events
+	unsigned long long flushes; // relay flush events
+	unsigned long long inventories; // receive inventory events
+	unsigned long long inventoryTxns; // transactions carried by them
+	unsigned long long compactBlocks; // compact blocks accepted
+	unsigned long long compactMisses; // of those, ones which needed a round trip for missing transactions
+	unsigned long long staleAvoided;
+	unsigned long long stalePopped;
+	unsigned long long messages; // events sent to another partition
+	unsigned long long windows; // synchronization windows
+	unsigned long long orphansExpired; // orphan blocks dropped by the orphan limits
+	unsigned long long reorgs; // tip switches to another branch, summed over nodes
+	unsigned long long undone; // blocks undone by those switches
+	double elapsed; // wall clock seconds
+	Time lastTime; // simulated time of the last event
+
+	RunStats() : events(0), ctc(0), cbc(0), rtc(0), rbc(0), flushes(0), inventories(0),
+		inventoryTxns(0), compactBlocks(0), compactMisses(0), staleAvoided(0),
+		stalePopped(0), messages(0), windows(0), orphansExpired(0), reorgs(0), undone(0), elapsed(0), lastTime(0) {}
+};
+
+// block tree statistics at the end of a run
+struct ChainMetrics {
+	unsigned long long blocks; // blocks created, genesis excluded
+	unsigned long long mainLength; // blocks on the main chain
+	unsigned long long forks; // blocks with more than one child
+	double staleRatio; // fraction of blocks off the main chain
+	double forkRate; // forks per main chain block
+	double growthRate; // main chain blocks per simulated second
+
+	ChainMetrics() : blocks(0), mainLength(0), forks(0), staleRatio(0), forkRate(0), growthRate(0) {}
+};
+
+// what finality pruning has freed so far
+struct PruneSummary {
+	unsigned long long prunes;
+	unsigned long long blocks; // blocks freed, genesis excluded
+	unsigned long long mainBlocks; // of those, main chain blocks below the final block
+	unsigned long long forks; // freed blocks with more than one child
+	unsigned long long txns; // transactions freed
+	unsigned long long bytes; // store and node memory given back, estimated
+	vector<unsigned long long> mainByCreator; // freed main chain blocks of each node
+
+	PruneSummary() : prunes(0), blocks(0), mainBlocks(0), forks(0), txns(0), bytes(0) {}
+};
+
+#endif // STATS_H
@@ -0,0 +1,205 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <vector>
+#include <new>
+#include <utility>
+#include <mutex>
+#include <stdint.h>
+#include "transaction.h"
+#include "block.h"
+#include "blocknode.h"
+
+using namespace std;
+
+// chunked object pool. objects never move once created, so a pointer to one
+// is its handle for as long as it lives, and destroyed slots are reused
+template <typename T>
+class Pool {
+public:
+	static const size_t CHUNK = 1024; // objects per chunk
+
+	Pool() : _used(CHUNK), _live(0) {}
+
+	~Pool() {
+		for (size_t c = 0; c < _chunks.size(); c++) {
+			size_t used = c + 1 == _chunks.size() ? _used : CHUNK;
+			for (size_t i = 0; i < used; i++) {
+				if (_chunks[c][i].live) {
+					_chunks[c][i].object()->~T();
+				}
+			}
+			delete[] _chunks[c];
+		}
+	}
+
+	template <typename... Args>
+	T* create(Args&&... args) {
+		Slot *slot;
+		if (!_free.empty()) {
+			slot = _free.back();
+			_free.pop_back();
+		} else {
+			if (_used == CHUNK) {
+				_chunks.push_back(new Slot[CHUNK]);
+				_used = 0;
+			}
+			slot = &_chunks.back()[_used++];
+		}
+		T *object = new (slot->storage) T(std::forward<Args>(args)...);
+		slot->live = true;
+		_live++;
+		return object;
+	}
+
+	// the object may come from another pool of the same type, its slot then
+	// serves this pool's creates while its chunk stays with the pool that
+	// allocated it, which also destroys it at the end if it is live
+	void destroy(const T *object) {
+		Slot *slot = reinterpret_cast<Slot*>(const_cast<T*>(object));
+		slot->object()->~T();
+		slot->live = false;
+		_free.push_back(slot);
+		_live--;
+	}
+
+	size_t live() const { return _live; }
+
+	size_t bytes() const { return _chunks.size() * CHUNK * sizeof(Slot); }
+
+private:
+	struct Slot {
+		alignas(T) char storage[sizeof(T)]; // first member, a T* is also a Slot*
+		bool live;
+
+		Slot() : live(false) {}
+
+		T* object() { return reinterpret_cast<T*>(storage); }
+	};
+
+	vector<Slot*> _chunks;
+	size_t _used; // slots handed out from the last chunk
+	size_t _live;
+	vector<Slot*> _free;
+};
+
+// owns every transaction and block of a network and the shared block tree.
+// each object is created once by the node that made it and afterwards only
+// referred to by pointer, in events, mempools, blocks and blockchains. a shard
+// is only written by the thread simulating its partition. every tree node
+// also gets a dense index, a node's BlockChain keeps its per block state in
+// arrays over these indexes.
+class ObjectStore {
+public:
+	struct Shard {
+		Pool<Transaction> txns;
+		Pool<Block> blocks;
+		Pool<BlockNode> nodes; // tree node of each block
+	};
+
+	ObjectStore(size_t shards) {
+		for (size_t i = 0; i < shards; i++) {
+			_shards.push_back(new Shard());
+		}
+		vector<const Transaction*> noTxns;
+		_genesis = create_block(0, GENESIS_ID, GENESIS_ID, noTxns, NULL);
+	}
+
+	~ObjectStore() {
+		for (Shard *shard : _shards) {
+			delete shard;
+		}
+	}
+
+	Shard& shard(size_t index) { return *_shards[index]; }
+
+	// root of the tree: the genesis block, or the final block of the last pruning
+	BlockNode* genesis() const { return _genesis; }
+
+	// creates a block and its tree node below parent. the index is taken under
+	// a lock, blocks are rare next to the other events
+	BlockNode* create_block(size_t shard, Id id, Id parentId, const vector<const Transaction*> &txns, BlockNode *parent,
+	                        Time created = 0) {
+		const Block *block = _shards[shard]->blocks.create(id, parentId, txns, created);
+		lock_guard<mutex> lock(_treeMutex);
+		BlockNode *node = _shards[shard]->nodes.create(block, parent, (uint32_t) _tree.size());
+		_tree.push_back(node);
+		return node;
+	}
+
+	// the remaining members must not be called while blocks are being created
+
+	// block without parent at the given height, a detached block read from a snapshot
+	BlockNode* create_parentless(size_t shard, Id id, Id parentId, const vector<const Transaction*> &txns, Time created,
+	                             unsigned long height) {
+		const Block *block = _shards[shard]->blocks.create(id, parentId, txns, created);
+		BlockNode *node = _shards[shard]->nodes.create(block, (BlockNode*) NULL, (uint32_t) _tree.size(), height);
+		_tree.push_back(node);
+		return node;
+	}
+
+	// replaces the genesis block, while it is the only block, by the root of
+	// a pruned tree read from a snapshot
+	BlockNode* replace_genesis(Id id, Id parentId, const vector<const Transaction*> &txns, Time created, unsigned long height) {
+		destroy_block(0, _genesis);
+		_tree.clear();
+		_genesis = create_parentless(0, id, parentId, txns, created, height);
+		return _genesis;
+	}
+
+	// frees a block and its tree node, which must have left the tree
+	void destroy_block(size_t shard, BlockNode *node) {
+		const Block *block = &node->block();
+		_shards[shard]->nodes.destroy(node);
+		_shards[shard]->blocks.destroy(block);
+	}
+
+	void destroy_txn(size_t shard, const Transaction *txn) { _shards[shard]->txns.destroy(txn); }
+
+	// replaces the tree by the given tree nodes, the first one the new root,
+	// and renumbers them in that order
+	void reindex(const vector<BlockNode*> &tree) {
+		_tree = tree;
+		for (uint32_t i = 0; i < _tree.size(); i++) {
+			_tree[i]->set_index(i);
+		}
+		_genesis = _tree[0];
+	}
+
+	// live objects over all shards
+	size_t live_txns() const {
+		size_t live = 0;
+		for (Shard *shard : _shards) {
+			live += shard->txns.live();
+		}
+		return live;
+	}
+
+	size_t live_blocks() const {
+		size_t live = 0;
+		for (Shard *shard : _shards) {
+			live += shard->blocks.live();
+		}
+		return live;
+	}
+
+	size_t blocks() const { return _tree.size(); }
+
+	BlockNode* block_node(uint32_t index) const { return _tree[index]; }
+
+	// calls f(node) for the tree node of every block, genesis included, by index
+	template <typename F>
+	void for_each_block(F f) {
+		for (BlockNode *node : _tree) {
+			f(node);
+		}
+	}
+
+private:
+	vector<Shard*> _shards; // allocated separately so partitions do not share cache lines
+	BlockNode *_genesis;
+	vector<BlockNode*> _tree; // tree node of each index
+	mutex _treeMutex;
+};
+
+#endif // STORE_H
@@ -0,0 +1,186 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "network.h"
+
+using namespace std;
+
+// one point of the parameter grid
+struct SweepConfig {
+	int n;
+	double z;
+	double txnRate;
+	double blockRate;
+};
+
+// runs independent replications of every grid point on a pool of threads and
+// prints one row of aggregated chain metrics per grid point. replication r of
+// every grid point uses seed + r, so grid points are compared on the same
+// random streams.
+class Sweep {
+public:
+	Sweep() : _replications(10), _jobs(thread::hardware_concurrency()), _maxEvents(0) {
+		_txnRates.push_back(1);
+		_blockRates.push_back(1);
+		if (_jobs == 0) {
+			_jobs = 1;
+		}
+	}
+
+	// ./a.out sweep <n list> <z list> <maxEvents> [--txn-rate=list] [--block-rate=list]
+	//              [--replications=k] [--jobs=j] [options]
+	// lists are comma separated, the remaining options apply to every run
+	bool parse(int argc, char **argv) {
+		if (argc < 5) {
+			return false;
+		}
+		_ns = parse_list<int>(argv[2]);
+		_zs = parse_list<double>(argv[3]);
+		_maxEvents = stoi(argv[4]);
+		vector<char*> rest(argv, argv + 5);
+		for (int i = 5; i < argc; i++) {
+			string arg = argv[i];
+			if (arg.compare(0, 11, "--txn-rate=") == 0) {
+				_txnRates = parse_list<double>(arg.substr(11));
+			} else if (arg.compare(0, 13, "--block-rate=") == 0) {
+				_blockRates = parse_list<double>(arg.substr(13));
+			} else if (arg.compare(0, 15, "--replications=") == 0) {
+				_replications = stoi(arg.substr(15));
+			} else if (arg.compare(0, 7, "--jobs=") == 0) {
+				_jobs = stoi(arg.substr(7));
+			} else {
+				rest.push_back(argv[i]);
+			}
+		}
+		if (!parse_options(rest.size(), rest.data(), 5, _options)) {
+			return false;
+		}
+		_options.logLevel = TRACE_SILENT;
+		_options.traceFile.clear();
+		_options.metricsFile.clear();
+		_options.profileFile.clear();
+		_options.progressInterval = 0;
+		return !_ns.empty() && !_zs.empty() && !_txnRates.empty() && !_blockRates.empty() && _replications > 0 && _jobs > 0;
+	}
+
+	void run() {
+		for (int n : _ns) {
+			for (double z : _zs) {
+				for (double txnRate : _txnRates) {
+					for (double blockRate : _blockRates) {
+						SweepConfig config = {n, z, txnRate, blockRate};
+						_configs.push_back(config);
+					}
+				}
+			}
+		}
+		size_t tasks = _configs.size() * _replications;
+		_metrics.assign(tasks, ChainMetrics());
+		_stats.assign(tasks, RunStats());
+		atomic<size_t> next(0);
+		vector<thread> workers;
+		for (int j = 0; j < _jobs; j++) {
+			workers.push_back(thread([this, &next, tasks] {
+				size_t task;
+				while ((task = next++) < tasks) {
+					run_task(task);
+				}
+			}));
+		}
+		for (thread &worker : workers) {
+			worker.join();
+		}
+		print();
+	}
+
+private:
+	vector<int> _ns;
+	vector<double> _zs;
+	vector<double> _txnRates;
+	vector<double> _blockRates;
+	int _replications;
+	int _jobs;
+	int _maxEvents;
+	Options _options;
+	vector<SweepConfig> _configs;
+	vector<ChainMetrics> _metrics; // per task, task = config * replications + replication
+	vector<RunStats> _stats;
+
+	template <typename T>
+	static vector<T> parse_list(const string &list) {
+		vector<T> values;
+		size_t start = 0;
+		while (start <= list.size()) {
+			size_t end = list.find(',', start);
+			if (end == string::npos) {
+				end = list.size();
+			}
+			if (end > start) {
+				values.push_back((T) stod(list.substr(start, end - start)));
+			}
+			start = end + 1;
+		}
+		return values;
+	}
+
+	void run_task(size_t task) {
+		const SweepConfig &config = _configs[task / _replications];
+		Options options = _options;
+		options.seed = _options.seed + task % _replications;
+		options.txnRate = config.txnRate;
+		options.blockRate = config.blockRate;
+		Network network(config.n, config.z, options);
+		network.simulate(_maxEvents);
+		_stats[task] = network.stats();
+		_metrics[task] = network.chain_metrics();
+	}
+
+	static void mean_sd(const vector<double> &values, double &mean, double &sd) {
+		mean = 0;
+		for (double value : values) {
+			mean += value;
+		}
+		mean /= values.size();
+		sd = 0;
+		for (double value : values) {
+			sd += (value - mean) * (value - mean);
+		}
+		sd = values.size() > 1 ? sqrt(sd / (values.size() - 1)) : 0;
+	}
+
+	void print() {
+		printf("n\tz\ttxn_rate\tblock_rate\treps\tblocks\tstale_ratio\tstale_sd\tfork_rate\tfork_sd\tgrowth_rate\tgrowth_sd\tevents\tseconds\n");
+		for (size_t c = 0; c < _configs.size(); c++) {
+			vector<double> stale, fork, growth;
+			double blocks = 0, events = 0, seconds = 0;
+			for (int r = 0; r < _replications; r++) {
+				size_t task = c * _replications + r;
+				stale.push_back(_metrics[task].staleRatio);
+				fork.push_back(_metrics[task].forkRate);
+				growth.push_back(_metrics[task].growthRate);
+				blocks += _metrics[task].blocks;
+				events += _stats[task].events;
+				seconds += _stats[task].elapsed;
+			}
+			double staleMean, staleSd, forkMean, forkSd, growthMean, growthSd;
+			mean_sd(stale, staleMean, staleSd);
+			mean_sd(fork, forkMean, forkSd);
+			mean_sd(growth, growthMean, growthSd);
+			const SweepConfig &config = _configs[c];
+			printf("%d\t%g\t%g\t%g\t%d\t%.1f\t%.4f\t%.4f\t%.4f\t%.4f\t%.4f\t%.4f\t%.0f\t%.3f\n",
+			       config.n, config.z, config.txnRate, config.blockRate, _replications,
+			       blocks / _replications, staleMean, staleSd, forkMean, forkSd, growthMean, growthSd,
+			       events / _replications, seconds / _replications);
+		}
+		fflush(stdout);
+	}
+};
+
+#endif // SWEEP_H
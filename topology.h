@@ -0,0 +1,227 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <vector>
+#include <string>
+#include "rng.h"
+#include <algorithm>
+#include <unordered_set>
+#include <cmath>
+#include <stdint.h>
+#include "links.h"
+
+using namespace std;
+
+// builds the undirected peer graph, at most one link per pair of nodes and no
+// self links. link attributes are left to the caller.
+class TopologyGenerator {
+public:
+	virtual ~TopologyGenerator() {}
+
+	virtual void generate(size_t n, unsigned long long seed, vector<Link> &links) = 0;
+
+	virtual const char* name() const = 0;
+
+protected:
+	static void add(vector<Link> &links, Id a, Id b) {
+		Link link = {a, b, 0, 0};
+		links.push_back(link);
+	}
+
+	static uint64_t key(size_t n, Id a, Id b) {
+		return a < b ? a * n + b : b * n + a;
+	}
+};
+
+// every pair is linked with probability 1/2, O(n^2). the original topology
+class DenseTopology : public TopologyGenerator {
+public:
+	void generate(size_t n, unsigned long long seed, vector<Link> &links) {
+		Stream generator(seed);
+		for (size_t i = 0; i < n; i++) {
+			for (size_t j = i+1; j < n; j++) {
+				if (generator() >> 63) {
+					add(links, i, j);
+				}
+			}
+		}
+	}
+
+	const char* name() const { return "dense"; }
+};
+
+// G(n, p) with p chosen for the given mean degree. the gaps between
+// successive links in the pair sequence are geometric, so only the links
+// themselves are visited (Batagelj and Brandes).
+class ErdosRenyiTopology : public TopologyGenerator {
+public:
+	ErdosRenyiTopology(double meanDegree) : _meanDegree(meanDegree) {}
+
+	void generate(size_t n, unsigned long long seed, vector<Link> &links) {
+		if (n < 2) {
+			return;
+		}
+		double p = min(1.0, _meanDegree / (n - 1));
+		if (p <= 0) {
+			return;
+		}
+		Stream generator(seed);
+		double logq = log(1 - p);
+		long long v = 1, w = -1;
+		while (v < (long long) n) {
+			if (p >= 1) {
+				w++;
+			} else {
+				w += 1 + (long long) floor(log(generator.uniform()) / logq);
+			}
+			while (w >= v && v < (long long) n) {
+				w -= v;
+				v++;
+			}
+			if (v < (long long) n) {
+				add(links, v, w);
+			}
+		}
+	}
+
+	const char* name() const { return "er"; }
+
+private:
+	double _meanDegree;
+};
+
+// configuration model: degree stubs are shuffled and paired. pairs that would
+// form a self link or a second link between the same nodes are dropped, so a
+// few nodes may end up slightly below the target degree.
+class RandomRegularTopology : public TopologyGenerator {
+public:
+	RandomRegularTopology(int degree) : _degree(degree) {}
+
+	void generate(size_t n, unsigned long long seed, vector<Link> &links) {
+		Stream generator(seed);
+		vector<Id> stubs;
+		stubs.reserve(n * _degree);
+		for (size_t i = 0; i < n; i++) {
+			for (int d = 0; d < _degree; d++) {
+				stubs.push_back(i);
+			}
+		}
+		// Fisher-Yates, so the pairing does not depend on the library's shuffle
+		for (size_t i = stubs.size(); i > 1; i--) {
+			swap(stubs[i - 1], stubs[generator.below(i)]);
+		}
+		unordered_set<uint64_t> linked;
+		linked.reserve(stubs.size() / 2);
+		for (size_t s = 0; s + 1 < stubs.size(); s += 2) {
+			Id a = stubs[s], b = stubs[s + 1];
+			if (a != b && linked.insert(key(n, a, b)).second) {
+				add(links, a, b);
+			}
+		}
+	}
+
+	const char* name() const { return "regular"; }
+
+private:
+	int _degree;
+};
+
+// preferential attachment: starts from a clique of m + 1 nodes, every further
+// node links to m distinct nodes picked with probability proportional to
+// their degree. endpoints of all links so far are kept in one array, so a
+// pick is a uniform index into it.
+class BarabasiAlbertTopology : public TopologyGenerator {
+public:
+	BarabasiAlbertTopology(int m) : _m(max(1, m)) {}
+
+	void generate(size_t n, unsigned long long seed, vector<Link> &links) {
+		Stream generator(seed);
+		size_t core = min(n, (size_t) _m + 1);
+		vector<Id> endpoints;
+		endpoints.reserve(2 * n * _m);
+		for (size_t i = 0; i < core; i++) {
+			for (size_t j = i+1; j < core; j++) {
+				add(links, i, j);
+				endpoints.push_back(i);
+				endpoints.push_back(j);
+			}
+		}
+		vector<Id> targets;
+		for (size_t v = core; v < n; v++) {
+			targets.clear();
+			while ((int) targets.size() < _m) {
+				Id t = endpoints[generator.below(endpoints.size())];
+				if (find(targets.begin(), targets.end(), t) == targets.end()) {
+					targets.push_back(t);
+				}
+			}
+			for (Id t : targets) {
+				add(links, v, t);
+				endpoints.push_back(v);
+				endpoints.push_back(t);
+			}
+		}
+	}
+
+	const char* name() const { return "ba"; }
+
+private:
+	int _m; // links added per node
+};
+
+// ring lattice where every node links to its k/2 nearest nodes on either side,
+// then the far end of each link is moved to a random node with probability beta
+class WattsStrogatzTopology : public TopologyGenerator {
+public:
+	WattsStrogatzTopology(int k, double beta) : _k(max(2, k)), _beta(beta) {}
+
+	void generate(size_t n, unsigned long long seed, vector<Link> &links) {
+		Stream generator(seed);
+		size_t half = min((size_t) _k / 2, n > 0 ? (n - 1) / 2 : 0);
+		unordered_set<uint64_t> linked;
+		linked.reserve(n * half);
+		for (size_t i = 0; i < n; i++) {
+			for (size_t d = 1; d <= half; d++) {
+				linked.insert(key(n, i, (i + d) % n));
+			}
+		}
+		for (size_t i = 0; i < n; i++) {
+			for (size_t d = 1; d <= half; d++) {
+				Id j = (i + d) % n;
+				if (generator.uniform() < _beta) {
+					Id r = generator.below(n);
+					if (r != i && !linked.count(key(n, i, r))) {
+						linked.erase(key(n, i, j));
+						linked.insert(key(n, i, r));
+						j = r;
+					}
+				}
+				add(links, i, j);
+			}
+		}
+	}
+
+	const char* name() const { return "ws"; }
+
+private:
+	int _k; // lattice degree
+	double _beta; // rewiring probability
+};
+
+// returns NULL if kind is not a known topology
+inline TopologyGenerator* make_topology(const string &kind, double degree, double rewire) {
+	if (kind == "dense") {
+		return new DenseTopology();
+	} else if (kind == "er") {
+		return new ErdosRenyiTopology(degree);
+	} else if (kind == "regular") {
+		return new RandomRegularTopology((int) degree);
+	} else if (kind == "ba") {
+		return new BarabasiAlbertTopology((int) round(degree / 2));
+	} else if (kind == "ws") {
+		return new WattsStrogatzTopology((int) degree, rewire);
+	}
+	return NULL;
+}
+
+#endif // TOPOLOGY_H
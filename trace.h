@@ -0,0 +1,470 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+
+using namespace std;
+
+// log levels
+const int TRACE_SILENT = 0; // nothing at all
+const int TRACE_SUMMARY = 1; // network and totals at the end of the run
+const int TRACE_EVENTS = 2; // one record per event handler outcome
+
+// record kinds
+const uint16_t TRACE_EVENT_BEGIN = 0;
+const uint16_t TRACE_EVENT_END = 1;
+const uint16_t TRACE_CREATE_TXN = 2;
+const uint16_t TRACE_CREATE_BLOCK = 3;
+const uint16_t TRACE_NO_TXNS = 4;
+const uint16_t TRACE_RECEIVE_TXN = 5;
+const uint16_t TRACE_RECEIVE_BLOCK = 6;
+
+// record flags
+const uint16_t TRACE_ACCEPTED = 1; // received object was new to the receiver
+const uint16_t TRACE_ORPHAN = 2; // received block's parent is missing
+
+// fixed size binary record, the text form is only produced when it is written out
+struct TraceRecord {
+	double time; // time of the event that logged the record
+	double value; // transaction amount or next block creation time
+	uint64_t object; // event counter, transaction id or block id
+	uint32_t node; // creator, payer or receiver
+	uint32_t peer; // payee or sender
+	uint16_t kind;
+	uint16_t flags;
+};
+
+const size_t TRACE_CHUNK_RECORDS = 1 << 14; // records buffered per thread before they are written
+const size_t TRACE_THREAD_SLOTS = 4; // tracers a thread keeps its chunk of
+
+const char TRACE_MAGIC[8] = {'P', '2', 'P', 'T', 'R', 'A', 'C', 'E'};
+const char TRACE_COLUMNS_MAGIC[8] = {'P', '2', 'P', 'T', 'R', 'C', 'O', 'L'};
+const uint32_t TRACE_VERSION = 2;
+
+// header of a binary trace file. a row trace continues with whole records,
+// a column trace with chunks that each store every field of a run of
+// records contiguously: a uint64 record count, then the time, value,
+// object, node, peer, kind and flags columns, padded to 8 bytes.
+struct TraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+};
+
+// bytes of a column chunk of count records, header and padding included
+inline size_t trace_column_bytes(size_t count) {
+	size_t fields = sizeof(double) * 2 + sizeof(uint64_t) + sizeof(uint32_t) * 2 + sizeof(uint16_t) * 2;
+	return sizeof(uint64_t) + (count * fields + 7) / 8 * 8;
+}
+
+// one chunk of a column trace, pointing into the mapped file
+struct TraceColumns {
+	size_t size;
+	const double *time;
+	const double *value;
+	const uint64_t *object;
+	const uint32_t *node;
+	const uint32_t *peer;
+	const uint16_t *kind;
+	const uint16_t *flags;
+
+	TraceRecord record(size_t i) const {
+		TraceRecord record = {time[i], value[i], object[i], node[i], peer[i], kind[i], flags[i]};
+		return record;
+	}
+};
+
+// maps a column trace into memory and walks its chunks without copying
+class ColumnTraceReader {
+public:
+	ColumnTraceReader() : _data(NULL), _size(0), _pos(0) {}
+
+	~ColumnTraceReader() {
+		if (_data != NULL) {
+			munmap((void*) _data, _size);
+		}
+	}
+
+	bool open(const string &path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return fail("can not open " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(TraceHeader)) {
+			::close(fd);
+			return fail(path + " is not a column trace");
+		}
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) {
+			return fail("can not map " + path);
+		}
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+		_data = (const char*) data;
+		_size = st.st_size;
+		const TraceHeader *header = (const TraceHeader*) _data;
+		if (memcmp(header->magic, TRACE_COLUMNS_MAGIC, sizeof(header->magic)) != 0) {
+			return fail(path + " is not a column trace");
+		}
+		if (header->version != TRACE_VERSION || header->recordSize != sizeof(TraceRecord)) {
+			return fail("unsupported trace version " + to_string(header->version));
+		}
+		_pos = sizeof(TraceHeader);
+		return true;
+	}
+
+	// starts over at the first chunk
+	void rewind() { _pos = sizeof(TraceHeader); }
+
+	// returns false at the end of the trace or on a truncated chunk
+	bool next(TraceColumns &columns) {
+		if (!_error.empty() || _size - _pos < sizeof(uint64_t)) {
+			return false;
+		}
+		uint64_t count = *(const uint64_t*) (_data + _pos);
+		if (count > TRACE_CHUNK_RECORDS || trace_column_bytes(count) > _size - _pos) {
+			return fail("truncated trace");
+		}
+		const char *p = _data + _pos + sizeof(uint64_t);
+		columns.size = count;
+		columns.time = (const double*) p;
+		columns.value = columns.time + count;
+		columns.object = (const uint64_t*) (columns.value + count);
+		columns.node = (const uint32_t*) (columns.object + count);
+		columns.peer = columns.node + count;
+		columns.kind = (const uint16_t*) (columns.peer + count);
+		columns.flags = columns.kind + count;
+		_pos += trace_column_bytes(count);
+		return true;
+	}
+
+	const string& error() const { return _error; }
+
+private:
+	const char *_data;
+	size_t _size;
+	size_t _pos;
+	string _error;
+
+	bool fail(const string &error) {
+		_error = error;
+		return false;
+	}
+};
+
+// writes the human readable form of a record
+void format_record(ostream &out, const TraceRecord &record) {
+	switch (record.kind) {
+		case TRACE_EVENT_BEGIN:
+			out << "------------------ Event " << record.object << " at " << record.time << " ----------------------\n";
+			break;
+		case TRACE_EVENT_END:
+			out << "\n";
+			break;
+		case TRACE_CREATE_TXN:
+			out << "Create Transaction " << record.object << ": " << record.node << "->" << record.peer << ", " << record.value << "\n";
+			break;
+		case TRACE_CREATE_BLOCK:
+			out << "Create Block " << record.object << ": " << record.node << "\n";
+			break;
+		case TRACE_NO_TXNS:
+			out << "new block creation time = " << record.value << "\n";
+			out << "No unspent transactions, block could not be created\n";
+			break;
+		case TRACE_RECEIVE_TXN:
+			out << "Receive Transaction " << record.object << ": " << record.node << "<-" << record.peer << " ";
+			out << (record.flags & TRACE_ACCEPTED ? "Successful" : "Rejected") << "\n";
+			break;
+		case TRACE_RECEIVE_BLOCK:
+			out << "Receive Block " << record.object << ": " << record.node << "<-" << record.peer << " ";
+			if (record.flags & TRACE_ORPHAN) {
+				out << "blockchain can not receive block " << record.object << "\n";
+			}
+			out << (record.flags & TRACE_ACCEPTED ? "Successful" : "Rejected") << "\n";
+			break;
+		default:
+			out << "unknown trace record " << record.kind << "\n";
+	}
+}
+
+struct TraceChunk {
+	TraceRecord records[TRACE_CHUNK_RECORDS];
+	size_t size;
+};
+
+// buffers records in memory and writes them out a chunk at a time, either as
+// raw records to a binary trace file or as text to stdout. each thread fills
+// its own chunk; when a background writer is running, full chunks are handed
+// to it through a small ring of reusable chunks.
+class Tracer {
+public:
+	Tracer(int level = TRACE_EVENTS) : _level(level), _out(stdout), _binary(false),
+		_columns(false), _async(false), _stop(false), _allocated(0)
+	{
+		_serial = next_serial()++;
+	}
+
+	~Tracer() {
+		close();
+	}
+
+	// binary output to path instead of text on stdout, as rows or columns
+	bool open(const string &path, bool columns = false) {
+		FILE *file = fopen(path.c_str(), "wb");
+		if (file == NULL) {
+			return false;
+		}
+		TraceHeader header;
+		memcpy(header.magic, columns ? TRACE_COLUMNS_MAGIC : TRACE_MAGIC, sizeof(header.magic));
+		header.version = TRACE_VERSION;
+		header.recordSize = sizeof(TraceRecord);
+		fwrite(&header, sizeof(header), 1, file);
+		_out = file;
+		_binary = true;
+		_columns = columns;
+		return true;
+	}
+
+	// writes full chunks on a background thread
+	void start_writer() {
+		if (!_async) {
+			_async = true;
+			_writer = thread(&Tracer::write_loop, this);
+		}
+	}
+
+	int level() const { return _level; }
+
+	void set_level(int level) { _level = level; }
+
+	bool enabled(int level) const { return _level >= level; }
+
+	void log(uint16_t kind, double time, double value, uint64_t object, uint32_t node, uint32_t peer, uint16_t flags = 0) {
+		TraceChunk *&chunk = local_chunk();
+		TraceRecord &record = chunk->records[chunk->size++];
+		record.time = time;
+		record.value = value;
+		record.object = object;
+		record.node = node;
+		record.peer = peer;
+		record.kind = kind;
+		record.flags = flags;
+		if (chunk->size == TRACE_CHUNK_RECORDS) {
+			chunk = submit(chunk);
+		}
+	}
+
+	// writes out everything logged so far by any thread. the caller must make
+	// sure that no other thread is logging meanwhile.
+	void flush() {
+		{
+			unique_lock<mutex> lock(_mutex);
+			for (TraceChunk *&chunk : _current) {
+				if (chunk->size > 0) {
+					if (_async) {
+						_queue.push_back(chunk);
+						_wake.notify_all();
+						chunk = take_chunk_locked(lock);
+					} else {
+						write_chunk(chunk);
+					}
+				}
+			}
+		}
+		if (_async) {
+			unique_lock<mutex> lock(_mutex);
+			_idle.wait(lock, [this] { return _queue.empty() && _writing == 0; });
+		}
+		fflush(_out);
+	}
+
+	void close() {
+		flush();
+		if (_async) {
+			{
+				lock_guard<mutex> lock(_mutex);
+				_stop = true;
+			}
+			_wake.notify_all();
+			_writer.join();
+			_async = false;
+		}
+		if (_out != stdout) {
+			fclose(_out);
+			_out = stdout;
+			_binary = false;
+			_columns = false;
+		}
+		for (TraceChunk *chunk : _current) {
+			delete chunk;
+		}
+		for (TraceChunk *chunk : _free) {
+			delete chunk;
+		}
+		_current.clear();
+		_free.clear();
+		_allocated = 0;
+		_serial = next_serial()++; // threads register a fresh chunk on their next log
+	}
+
+private:
+	int _level;
+	FILE *_out;
+	bool _binary;
+	bool _columns; // binary output as column chunks
+	bool _async;
+	bool _stop;
+	unsigned long _serial;
+	size_t _allocated; // chunks owned by this tracer
+	int _writing = 0; // chunks being written by the background thread
+	deque<TraceChunk*> _current; // chunk being filled by each thread, never moves
+	vector<TraceChunk*> _free;
+	deque<TraceChunk*> _queue; // full chunks waiting for the writer
+	thread _writer;
+	mutex _mutex;
+	condition_variable _wake; // writer waits for work
+	condition_variable _idle; // producers wait for a free chunk or an empty queue
+
+	static atomic<unsigned long>& next_serial() {
+		static atomic<unsigned long> serial(1);
+		return serial;
+	}
+
+	// chunk of the calling thread, registered on first use. a thread keeps
+	// the slots of the last few tracers it logged to, newest first, keyed by
+	// serial so networks traced on the same thread never share a chunk. a
+	// slot dropped from the list is registered again, the old chunk stays in
+	// _current and is still flushed
+	TraceChunk*& local_chunk() {
+		static thread_local vector<pair<unsigned long, TraceChunk**> > slots;
+		for (size_t i = 0; i < slots.size(); i++) {
+			if (slots[i].first == _serial) {
+				if (i > 0) {
+					swap(slots[i], slots[0]);
+				}
+				return *slots[0].second;
+			}
+		}
+		lock_guard<mutex> lock(_mutex);
+		_current.push_back(new TraceChunk());
+		_current.back()->size = 0;
+		_allocated++;
+		if (slots.size() == TRACE_THREAD_SLOTS) {
+			slots.pop_back();
+		}
+		slots.insert(slots.begin(), make_pair(_serial, &_current.back()));
+		return *slots[0].second;
+	}
+
+	// hands a full chunk over and returns the chunk to continue with
+	TraceChunk* submit(TraceChunk *chunk) {
+		if (!_async) {
+			write_chunk(chunk);
+			return chunk;
+		}
+		unique_lock<mutex> lock(_mutex);
+		_queue.push_back(chunk);
+		_wake.notify_all();
+		return take_chunk_locked(lock);
+	}
+
+	// at most two chunks per thread plus a few spare are in flight, beyond that
+	// a producer waits for the writer to catch up
+	TraceChunk* take_chunk_locked(unique_lock<mutex> &lock) {
+		if (_free.empty() && _allocated < 2 * _current.size() + 4) {
+			_allocated++;
+			return reuse(new TraceChunk());
+		}
+		_idle.wait(lock, [this] { return !_free.empty(); });
+		TraceChunk *chunk = _free.back();
+		_free.pop_back();
+		return reuse(chunk);
+	}
+
+	TraceChunk* reuse(TraceChunk *chunk) {
+		chunk->size = 0;
+		return chunk;
+	}
+
+	void write_chunk(TraceChunk *chunk) {
+		if (_columns) {
+			write_columns(chunk);
+		} else if (_binary) {
+			fwrite(chunk->records, sizeof(TraceRecord), chunk->size, _out);
+		} else {
+			ostringstream text;
+			for (size_t i = 0; i < chunk->size; i++) {
+				format_record(text, chunk->records[i]);
+			}
+			const string &s = text.str();
+			fwrite(s.data(), 1, s.size(), _out);
+		}
+		chunk->size = 0;
+	}
+
+	// transposes the chunk and writes it with one call, so chunks of
+	// different threads never interleave
+	void write_columns(TraceChunk *chunk) {
+		static thread_local vector<char> buffer;
+		size_t n = chunk->size;
+		buffer.assign(trace_column_bytes(n), 0);
+		*(uint64_t*) &buffer[0] = n;
+		double *time = (double*) &buffer[sizeof(uint64_t)];
+		double *value = time + n;
+		uint64_t *object = (uint64_t*) (value + n);
+		uint32_t *node = (uint32_t*) (object + n);
+		uint32_t *peer = node + n;
+		uint16_t *kind = (uint16_t*) (peer + n);
+		uint16_t *flags = kind + n;
+		for (size_t i = 0; i < n; i++) {
+			const TraceRecord &record = chunk->records[i];
+			time[i] = record.time;
+			value[i] = record.value;
+			object[i] = record.object;
+			node[i] = record.node;
+			peer[i] = record.peer;
+			kind[i] = record.kind;
+			flags[i] = record.flags;
+		}
+		fwrite(buffer.data(), 1, buffer.size(), _out);
+		chunk->size = 0;
+	}
+
+	void write_loop() {
+		unique_lock<mutex> lock(_mutex);
+		while (true) {
+			_wake.wait(lock, [this] { return _stop || !_queue.empty(); });
+			if (_queue.empty()) {
+				return;
+			}
+			TraceChunk *chunk = _queue.front();
+			_queue.pop_front();
+			_writing++;
+			lock.unlock();
+			write_chunk(chunk);
+			lock.lock();
+			_writing--;
+			_free.push_back(chunk);
+			_idle.notify_all();
+		}
+	}
+};
+
+#endif // TRACE_H
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include "trace.h"
+
+using namespace std;
+
+// prints a binary trace written with --trace-file, rows or columns, in the
+// simulator's text format
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		cout << "Usage: " << argv[0] << " [trace file]" << endl;
+		exit(0);
+	}
+
+	ColumnTraceReader columns;
+	if (columns.open(argv[1])) {
+		TraceColumns chunk;
+		while (columns.next(chunk)) {
+			ostringstream text;
+			for (size_t i = 0; i < chunk.size; i++) {
+				format_record(text, chunk.record(i));
+			}
+			const string &s = text.str();
+			fwrite(s.data(), 1, s.size(), stdout);
+		}
+		if (!columns.error().empty()) {
+			cout << columns.error() << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		cout << "can not open " << argv[1] << endl;
+		return 1;
+	}
+	TraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		cout << argv[1] << " is not a trace file" << endl;
+		return 1;
+	}
+	if (header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+		cout << "unsupported trace version " << header.version << endl;
+		return 1;
+	}
+
+	vector<TraceRecord> records(TRACE_CHUNK_RECORDS);
+	size_t count;
+	while ((count = fread(records.data(), sizeof(TraceRecord), records.size(), file)) > 0) {
+		ostringstream text;
+		for (size_t i = 0; i < count; i++) {
+			format_record(text, records[i]);
+		}
+		const string &s = text.str();
+		fwrite(s.data(), 1, s.size(), stdout);
+	}
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,177 @@
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "trace.h"
+
+using namespace std;
+
+// a created block and the times at which nodes accepted it
+struct BlockSpread {
+	uint64_t id;
+	uint32_t creator;
+	double created;
+	vector<double> received;
+};
+
+// receive counts and latencies of one node
+struct NodeReceives {
+	unsigned long long blocks, blockDuplicates, txns, txnDuplicates;
+	double blockLatency, maxBlockLatency, txnLatency;
+
+	NodeReceives() : blocks(0), blockDuplicates(0), txns(0), txnDuplicates(0),
+		blockLatency(0), maxBlockLatency(0), txnLatency(0) {}
+};
+
+// time after creation at which the given fraction of n nodes had the block,
+// -1 if it never got that far. received must be sorted
+double reach_time(const BlockSpread &block, double fraction, size_t n) {
+	size_t needed = (size_t) (fraction * n + 0.999999);
+	if (needed == 0 || needed > block.received.size()) {
+		return -1;
+	}
+	return block.received[needed - 1] - block.created;
+}
+
+double duplicate_ratio(unsigned long long duplicates, unsigned long long all) {
+	return all > 0 ? (double) duplicates / all : 0;
+}
+
+// scans a column trace (--trace-format=columns) in place. a first pass
+// collects creation times, a second one the receives, so chunks of
+// different threads may come in any order
+int main(int argc, char **argv) {
+	string report = argc > 2 ? argv[2] : "summary";
+	if (argc < 2 || argc > 3 || (report != "summary" && report != "blocks" && report != "nodes")) {
+		cout << "Usage: " << argv[0] << " [trace file] [summary|blocks|nodes]" << endl;
+		exit(0);
+	}
+	ColumnTraceReader trace;
+	if (!trace.open(argv[1])) {
+		cout << trace.error() << endl;
+		return 1;
+	}
+
+	vector<BlockSpread> blocks;
+	unordered_map<uint64_t,size_t> blockIndex; // block id -> blocks index
+	unordered_map<uint64_t,double> txnCreated;
+	unsigned long long records = 0, events = 0;
+	uint32_t nodes = 0;
+	TraceColumns chunk;
+	while (trace.next(chunk)) {
+		records += chunk.size;
+		for (size_t i = 0; i < chunk.size; i++) {
+			uint16_t kind = chunk.kind[i];
+			if (kind == TRACE_EVENT_BEGIN) {
+				events++;
+			} else if (kind == TRACE_CREATE_BLOCK) {
+				blockIndex[chunk.object[i]] = blocks.size();
+				BlockSpread block = {chunk.object[i], chunk.node[i], chunk.time[i], vector<double>(1, chunk.time[i])};
+				blocks.push_back(block);
+				nodes = max(nodes, chunk.node[i] + 1);
+			} else if (kind == TRACE_CREATE_TXN) {
+				txnCreated[chunk.object[i]] = chunk.time[i];
+				nodes = max(nodes, chunk.node[i] + 1);
+			} else if (kind == TRACE_RECEIVE_TXN || kind == TRACE_RECEIVE_BLOCK) {
+				nodes = max(nodes, chunk.node[i] + 1);
+			}
+		}
+	}
+	if (!trace.error().empty()) {
+		cout << trace.error() << endl;
+		return 1;
+	}
+
+	vector<NodeReceives> receives(nodes);
+	trace.rewind();
+	while (trace.next(chunk)) {
+		for (size_t i = 0; i < chunk.size; i++) {
+			uint16_t kind = chunk.kind[i];
+			if (kind != TRACE_RECEIVE_TXN && kind != TRACE_RECEIVE_BLOCK) {
+				continue;
+			}
+			NodeReceives &node = receives[chunk.node[i]];
+			bool accepted = chunk.flags[i] & TRACE_ACCEPTED;
+			if (kind == TRACE_RECEIVE_BLOCK) {
+				unordered_map<uint64_t,size_t>::iterator it = blockIndex.find(chunk.object[i]);
+				if (!accepted) {
+					node.blockDuplicates++;
+				} else if (it != blockIndex.end()) {
+					BlockSpread &block = blocks[it->second];
+					double latency = chunk.time[i] - block.created;
+					block.received.push_back(chunk.time[i]);
+					node.blocks++;
+					node.blockLatency += latency;
+					node.maxBlockLatency = max(node.maxBlockLatency, latency);
+				}
+			} else {
+				unordered_map<uint64_t,double>::iterator it = txnCreated.find(chunk.object[i]);
+				if (!accepted) {
+					node.txnDuplicates++;
+				} else if (it != txnCreated.end()) {
+					node.txns++;
+					node.txnLatency += chunk.time[i] - it->second;
+				}
+			}
+		}
+	}
+	for (BlockSpread &block : blocks) {
+		sort(block.received.begin(), block.received.end());
+	}
+
+	if (report == "blocks") {
+		// propagation curve of every block: reach and time to half, 90% and all nodes
+		printf("block\tcreator\tcreated\treached\tt50\tt90\tt100\n");
+		for (const BlockSpread &block : blocks) {
+			printf("%llu\t%u\t%.6f\t%zu\t%.6f\t%.6f\t%.6f\n", (unsigned long long) block.id, block.creator, block.created,
+			       block.received.size(), reach_time(block, 0.5, nodes), reach_time(block, 0.9, nodes), reach_time(block, 1, nodes));
+		}
+	} else if (report == "nodes") {
+		printf("node\tblocks\tblock_latency\tmax_block_latency\tblock_dup_ratio\ttxns\ttxn_latency\ttxn_dup_ratio\n");
+		for (uint32_t i = 0; i < nodes; i++) {
+			const NodeReceives &node = receives[i];
+			printf("%u\t%llu\t%.6f\t%.6f\t%.4f\t%llu\t%.6f\t%.4f\n", i, node.blocks,
+			       node.blocks > 0 ? node.blockLatency / node.blocks : 0, node.maxBlockLatency,
+			       duplicate_ratio(node.blockDuplicates, node.blocks + node.blockDuplicates), node.txns,
+			       node.txns > 0 ? node.txnLatency / node.txns : 0, duplicate_ratio(node.txnDuplicates, node.txns + node.txnDuplicates));
+		}
+	} else {
+		NodeReceives total;
+		for (const NodeReceives &node : receives) {
+			total.blocks += node.blocks;
+			total.blockDuplicates += node.blockDuplicates;
+			total.blockLatency += node.blockLatency;
+			total.maxBlockLatency = max(total.maxBlockLatency, node.maxBlockLatency);
+			total.txns += node.txns;
+			total.txnDuplicates += node.txnDuplicates;
+			total.txnLatency += node.txnLatency;
+		}
+		// mean time to reach half, 90% and all nodes over the blocks that got there
+		double sums[3] = {0, 0, 0};
+		size_t counts[3] = {0, 0, 0};
+		double fractions[3] = {0.5, 0.9, 1};
+		for (const BlockSpread &block : blocks) {
+			for (int f = 0; f < 3; f++) {
+				double t = reach_time(block, fractions[f], nodes);
+				if (t >= 0) {
+					sums[f] += t;
+					counts[f]++;
+				}
+			}
+		}
+		cout << "records = " << records << ", events = " << events << ", nodes = " << nodes << endl;
+		cout << "blocks = " << blocks.size() << ", transactions = " << txnCreated.size() << endl;
+		for (int f = 0; f < 3; f++) {
+			cout << "blocks reaching " << fractions[f] * 100 << "% of nodes = " << counts[f]
+			     << ", mean time = " << (counts[f] > 0 ? sums[f] / counts[f] : 0) << endl;
+		}
+		cout << "block receive latency: mean = " << (total.blocks > 0 ? total.blockLatency / total.blocks : 0)
+		     << ", max = " << total.maxBlockLatency << endl;
+		cout << "transaction receive latency: mean = " << (total.txns > 0 ? total.txnLatency / total.txns : 0) << endl;
+		cout << "duplicate deliveries: blocks = " << duplicate_ratio(total.blockDuplicates, total.blocks + total.blockDuplicates)
+		     << ", transactions = " << duplicate_ratio(total.txnDuplicates, total.txns + total.txnDuplicates) << endl;
+	}
+	return 0;
+}
@@ -3,15 +3,20 @@
 
 #include "types.h"
 
-int txnIdCounter = 0;
+// ids are handed out per creator so they do not depend on the order in which
+// nodes are simulated: the k-th object created by node i out of n gets k*n + i
+inline Id creator_scoped_id(unsigned long long k, Id creator, size_t n) {
+    return k * n + creator;
+}
 
 class Transaction {
 public:
-    Transaction(Id payer, Id payee, Coin amount) {
-        _id = txnIdCounter++;
+    Transaction(Id id, Id payer, Id payee, Coin amount, Time created = 0) {
+        _id = id;
         _payer = payer;
         _payee = payee;
         _amount = amount;
+        _created = created;
     }
 
     Id id() const { return _id; }
@@ -21,11 +26,15 @@ public:
     Id payee() const { return _payee; }
 
     Coin amount() const { return _amount; }
+
+    // simulated time at which the payer created it
+    Time created() const { return _created; }
 private:
     Id _id;
     Id _payer;
     Id _payee;
     Coin _amount;
+    Time _created;
 };
 
 #endif // TRANSACTION_H
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <cstddef>
+
 typedef unsigned long long Id;
 typedef double Coin;
 typedef unsigned int NodeType;
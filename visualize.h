@@ -1,33 +1,171 @@
 #ifndef VISUALIZE_H
 #define VISUALIZE_H
 
-#include <fstream>
-#include "blockchain.h"
+#include <cstdio>
+#include <cstdarg>
+#include <string>
+#include <vector>
+#include <thread>
+#include "node.h"
+#include "store.h"
 
 using namespace std;
 
-void output_blockchain(BlockChain &blockChain, string filename) {
-	map<Id,BlockNode*> blockMap = blockChain.blockMap();
-	ofstream file(filename, ios::out);
-	if (!file.is_open()) {
-		cout << "can not open " << filename << endl;
+const int EXPORT_DOT = 0; // graphviz, one vertex per block with counts, edges to the parent
+const int EXPORT_JSON = 1; // one object per block with every arrival
+const int EXPORT_CSV = 2; // one row per block, arrivals as node:time pairs
+
+// format of an export file by its extension, dot for any other
+inline int export_format(const string &path) {
+	size_t dot = path.rfind('.');
+	string extension = dot == string::npos ? "" : path.substr(dot + 1);
+	if (extension == "json") {
+		return EXPORT_JSON;
+	} else if (extension == "csv") {
+		return EXPORT_CSV;
 	}
-	file << "digraph G {" << endl;
-	for (auto b : blockMap) {
-		if (b.second->parentNode() != NULL) {
-			file << b.first << " -> " << b.second->parentNode()->block().id() << endl;
+	return EXPORT_DOT;
+}
+
+// writes the shared block tree once instead of one graph per node. every
+// block is annotated with the nodes that have connected it, their arrival
+// times and the nodes whose top it is. blocks are formatted in ranges by
+// several threads, each range into its own buffer, and the buffers are
+// written out in order as soon as a round of ranges is done.
+class TreeExporter {
+public:
+	static const uint32_t RANGE = 256; // blocks per buffer
+
+	TreeExporter(ObjectStore &store, const vector<Node*> &nodes, BlockNode *mainTop, int format) :
+		_store(store), _nodes(nodes), _format(format), _onMain(store.blocks(), false), _tips(store.blocks())
+	{
+		for (BlockNode *block = mainTop; block != NULL; block = block->parentNode()) {
+			_onMain[block->index()] = true;
+		}
+		for (Node *node : nodes) {
+			_tips[node->blockChain().top()->index()].push_back(node->id());
 		}
 	}
-	file << "}";
-	file.close();
-}
 
-void visualize_blockchain(Node *node) {
-	string filename = "graphs/" + std::to_string(node->id()) + ".dot";
-	output_blockchain(node->blockChain(), filename);
-}
+	// returns false if the file can not be written
+	bool write(const string &path, unsigned threads) {
+		FILE *out = fopen(path.c_str(), "w");
+		if (out == NULL) {
+			return false;
+		}
+		threads = max(1U, threads);
+		const char *header[] = {"digraph G {\n", "{\"nodes\": ", "block,parent,height,creator,created,main,holders,tips,arrivals\n"};
+		string text = header[_format];
+		if (_format == EXPORT_JSON) {
+			text += to_string(_nodes.size()) + ", \"blocks\": [";
+		}
+		fwrite(text.data(), 1, text.size(), out);
+
+		uint32_t blocks = _store.blocks();
+		vector<string> buffers(threads);
+		for (uint32_t first = 0; first < blocks; first += threads * RANGE) {
+			vector<thread> workers;
+			for (unsigned t = 0; t < threads; t++) {
+				uint32_t begin = min(blocks, first + t * RANGE);
+				uint32_t end = min(blocks, begin + RANGE);
+				buffers[t].clear();
+				if (t == 0) {
+					continue;
+				}
+				workers.push_back(thread(&TreeExporter::format_range, this, begin, end, ref(buffers[t])));
+			}
+			format_range(first, min(blocks, first + RANGE), buffers[0]);
+			for (thread &worker : workers) {
+				worker.join();
+			}
+			for (const string &buffer : buffers) {
+				fwrite(buffer.data(), 1, buffer.size(), out);
+			}
+		}
+
+		text = _format == EXPORT_DOT ? "}\n" : _format == EXPORT_JSON ? "\n]}\n" : "";
+		fwrite(text.data(), 1, text.size(), out);
+		bool ok = !ferror(out);
+		return fclose(out) == 0 && ok;
+	}
+
+private:
+	ObjectStore &_store;
+	const vector<Node*> &_nodes;
+	int _format;
+	vector<bool> _onMain; // by tree node index
+	vector<vector<Id> > _tips; // by tree node index, nodes whose top the block is
+
+	static void append(string &out, const char *format, ...) {
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		int length = vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		out.append(buffer, min((size_t) length, sizeof(buffer) - 1));
+	}
+
+	static void append_ids(string &out, const vector<Id> &ids, const char *separator) {
+		for (size_t i = 0; i < ids.size(); i++) {
+			append(out, "%s%llu", i > 0 ? separator : "", ids[i]);
+		}
+	}
+
+	void format_range(uint32_t begin, uint32_t end, string &out) {
+		// arrivals of the range's blocks, gathered node by node
+		vector<vector<pair<Id,Time> > > arrivals(end - begin);
+		for (Node *node : _nodes) {
+			const BlockChain &chain = node->blockChain();
+			for (uint32_t i = begin; i < end; i++) {
+				const BlockNode *block = _store.block_node(i);
+				if (chain.contains(block)) {
+					arrivals[i - begin].push_back(make_pair(node->id(), chain.arrival_time(block)));
+				}
+			}
+		}
+		for (uint32_t i = begin; i < end; i++) {
+			const BlockNode *block = _store.block_node(i);
+			const vector<pair<Id,Time> > &holders = arrivals[i - begin];
+			// a pruned tree's root still names its freed parent
+			bool genesis = block->id() == GENESIS_ID;
+			Id parent = genesis ? block->id() : block->block().parentId();
+			long long creator = genesis ? -1 : (long long) ((block->id() - GENESIS_ID - 1) % _nodes.size());
+			if (_format == EXPORT_DOT) {
+				append(out, "%llu [label=\"%llu\\nh=%lu holders=%zu tips=%zu\"%s", block->id(), block->id(),
+				       block->height(), holders.size(), _tips[i].size(), _onMain[i] ? ", style=filled" : "");
+				if (!_tips[i].empty()) {
+					out += ", tooltip=\"top of ";
+					append_ids(out, _tips[i], " ");
+					out += "\"";
+				}
+				out += "]\n";
+				if (block->parentNode() != NULL) {
+					append(out, "%llu -> %llu\n", block->id(), parent);
+				}
+			} else if (_format == EXPORT_JSON) {
+				append(out, "%s\n{\"id\": %llu, \"parent\": %llu, \"height\": %lu, \"creator\": %lld, \"created\": %.9g, \"main\": %s, \"tips\": [",
+				       i > 0 ? "," : "", block->id(), parent, block->height(), creator, block->block().created(), _onMain[i] ? "true" : "false");
+				append_ids(out, _tips[i], ", ");
+				out += "], \"arrivals\": [";
+				for (size_t h = 0; h < holders.size(); h++) {
+					append(out, "%s[%llu, %.9g]", h > 0 ? ", " : "", holders[h].first, holders[h].second);
+				}
+				out += "]}";
+			} else {
+				append(out, "%llu,%llu,%lu,%lld,%.9g,%d,%zu,", block->id(), parent, block->height(), creator,
+				       block->block().created(), (int) _onMain[i], holders.size());
+				append_ids(out, _tips[i], ";");
+				out += ",";
+				for (size_t h = 0; h < holders.size(); h++) {
+					append(out, "%s%llu:%.9g", h > 0 ? ";" : "", holders[h].first, holders[h].second);
+				}
+				out += "\n";
+			}
+		}
+	}
+};
 
 #endif // VISUALIZE_H
 
-// dot -Tps output.dot -o graph.ps
-// if you want to have a interaction with  "graph.ps" then run "gv graph.ps" on command line
\ No newline at end of file
+// dot -Tps blocktree.dot -o blocktree.ps
+// if you want to have a interaction with "blocktree.ps" then run "gv blocktree.ps" on command line